@@ -0,0 +1,405 @@
+/* =============================================================================
+ *
+ * Title:       In-memory compressed arrays
+ * Author:      Felix Niederwanger
+ * License:     MIT (http://opensource.org/licenses/MIT)
+ * Description: Arrays and cubes that are held as independently compressed
+ *              blocks (byte-shuffle followed by a fast LZ codec). Blocks are
+ *              decompressed lazily on access into a small block cache.
+ *              Standalone header file
+ * =============================================================================
+ */
+
+#ifndef _NUMERIC_COMPRESSED_HPP_
+#define _NUMERIC_COMPRESSED_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "numeric.hpp"
+
+namespace numeric {
+
+/** Block codec used by the compressed containers */
+namespace codec {
+
+/** Byte-shuffle n elements of the given size: All first bytes, then all second bytes, ... */
+inline void shuffle(const uint8_t* src, uint8_t* dst, const size_t n, const size_t typesize) {
+	for(size_t b=0;b<typesize;b++) {
+		uint8_t* out = dst + b*n;
+		for(size_t i=0;i<n;i++)
+			out[i] = src[i*typesize+b];
+	}
+}
+
+/** Reverse of shuffle */
+inline void unshuffle(const uint8_t* src, uint8_t* dst, const size_t n, const size_t typesize) {
+	for(size_t b=0;b<typesize;b++) {
+		const uint8_t* in = src + b*n;
+		for(size_t i=0;i<n;i++)
+			dst[i*typesize+b] = in[i];
+	}
+}
+
+static inline uint32_t lz_read32(const uint8_t* p) {
+	uint32_t ret;
+	memcpy(&ret, p, sizeof(ret));
+	return ret;
+}
+
+/** Write a LZ length extension (the part exceeding the 4 bit token field). Returns false on overflow */
+static inline bool lz_write_length(uint8_t* dst, size_t &op, const size_t cap, size_t len) {
+	while(len >= 255) {
+		if(op >= cap) return false;
+		dst[op++] = 255;
+		len -= 255;
+	}
+	if(op >= cap) return false;
+	dst[op++] = (uint8_t)len;
+	return true;
+}
+
+/** Emit a sequence of literals followed by an optional match (match_len == 0 for the last sequence) */
+static inline bool lz_emit(uint8_t* dst, size_t &op, const size_t cap, const uint8_t* literals, const size_t lit_len, const size_t offset, const size_t match_len) {
+	const size_t ml = (match_len > 0) ? match_len-4 : 0;
+	if(op >= cap) return false;
+	dst[op++] = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+	if(lit_len >= 15 && !lz_write_length(dst, op, cap, lit_len-15)) return false;
+	if(op + lit_len > cap) return false;
+	memcpy(dst+op, literals, lit_len);
+	op += lit_len;
+	if(match_len == 0) return true;
+	if(op + 2 > cap) return false;
+	dst[op++] = (uint8_t)(offset & 0xFF);
+	dst[op++] = (uint8_t)(offset >> 8);
+	if(ml >= 15 && !lz_write_length(dst, op, cap, ml-15)) return false;
+	return true;
+}
+
+/**
+ * Compress n bytes with a LZ77 byte codec (LZ4-like sequence format, 64k window)
+ * @param cap capacity of dst
+ * @return size of the compressed data or 0, if it would not fit into cap bytes
+ */
+inline size_t lz_compress(const uint8_t* src, const size_t n, uint8_t* dst, const size_t cap) {
+	const int hash_bits = 12;
+	uint32_t table[1 << hash_bits];		// Last position+1 of a 4-byte sequence, 0 = empty
+	memset(table, 0, sizeof(table));
+
+	size_t ip = 0, anchor = 0, op = 0;
+	while(ip + 4 <= n) {
+		const uint32_t seq = lz_read32(src+ip);
+		const uint32_t h = (seq * 2654435761U) >> (32 - hash_bits);
+		const size_t ref = table[h];
+		table[h] = (uint32_t)(ip+1);
+		if(ref == 0 || ip-(ref-1) > 65535 || lz_read32(src+ref-1) != seq) {
+			// Skip faster through incompressible data
+			ip += 1 + ((ip-anchor) >> 8);
+			continue;
+		}
+		const size_t match = ref-1;
+		size_t len = 4;
+		while(ip+len < n && src[match+len] == src[ip+len]) len++;
+		if(!lz_emit(dst, op, cap, src+anchor, ip-anchor, ip-match, len)) return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if(!lz_emit(dst, op, cap, src+anchor, n-anchor, 0, 0)) return 0;
+	return op;
+}
+
+/**
+ * Decompress data created by lz_compress
+ * @param cap capacity of dst
+ * @return number of decompressed bytes or 0, if the input is corrupt
+ */
+inline size_t lz_decompress(const uint8_t* src, const size_t n, uint8_t* dst, const size_t cap) {
+	size_t ip = 0, op = 0;
+	while(ip < n) {
+		const uint8_t token = src[ip++];
+		size_t lit_len = token >> 4;
+		if(lit_len == 15) {
+			uint8_t b;
+			do {
+				if(ip >= n) return 0;
+				b = src[ip++];
+				lit_len += b;
+			} while(b == 255);
+		}
+		if(ip + lit_len > n || op + lit_len > cap) return 0;
+		memcpy(dst+op, src+ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+		if(ip >= n) break;		// Last sequence has no match
+
+		if(ip + 2 > n) return 0;
+		const size_t offset = (size_t)src[ip] | ((size_t)src[ip+1] << 8);
+		ip += 2;
+		size_t match_len = (token & 0x0F) + 4;
+		if((token & 0x0F) == 15) {
+			uint8_t b;
+			do {
+				if(ip >= n) return 0;
+				b = src[ip++];
+				match_len += b;
+			} while(b == 255);
+		}
+		if(offset == 0 || offset > op || op + match_len > cap) return 0;
+		// Byte-wise copy, since source and destination might overlap
+		const uint8_t* match = dst + op - offset;
+		for(size_t i=0;i<match_len;i++)
+			dst[op+i] = match[i];
+		op += match_len;
+	}
+	return op;
+}
+
+}
+
+
+/**
+ * Array held in memory as independently compressed blocks of blockSize elements.
+ * Element access decompresses the containing block into a small LRU block cache;
+ * modified cached blocks are recompressed on eviction or flush().
+ * The block cache makes element access not thread-safe, also for const access.
+ */
+template <class T>
+class CompressedArray {
+protected:
+	/** Compressed block. Blocks that do not compress are stored raw */
+	struct Block {
+		std::vector<uint8_t> data;
+		bool raw;
+	};
+	/** Decompressed block in the block cache */
+	struct CacheEntry {
+		size_t block;
+		std::vector<T> val;
+		bool dirty;
+		unsigned long used;
+	};
+
+	size_t n;
+	size_t blockSize;
+	/**
+	 * Compressed blocks and the block cache are mutable: const access may evict a modified
+	 * cached block and recompress it, which changes the representation but not the values
+	 */
+	mutable std::vector<Block> blocks;
+
+	size_t cacheBlocks;
+	mutable std::vector<CacheEntry> cache;
+	mutable unsigned long clock;
+
+	/** Number of elements in the given block */
+	size_t blockLength(const size_t b) const {
+		const size_t begin = b*blockSize;
+		return (n - begin < blockSize) ? n - begin : blockSize;
+	}
+
+	/** Compress len elements into the given block */
+	void compressBlock(const size_t b, const T* src, const size_t len) const {
+		const size_t bytes = len*sizeof(T);
+		std::vector<uint8_t> shuffled(bytes);
+		codec::shuffle((const uint8_t*)src, shuffled.data(), len, sizeof(T));
+		Block &block = this->blocks[b];
+		block.data.resize(bytes);
+		const size_t compressed = codec::lz_compress(shuffled.data(), bytes, block.data.data(), bytes);
+		if(compressed == 0) {
+			block.raw = true;
+			memcpy(block.data.data(), src, bytes);
+		} else {
+			block.raw = false;
+			block.data.resize(compressed);
+		}
+		block.data.shrink_to_fit();
+	}
+
+	/**
+	 * Decompress the given block into dst, which must hold blockLength(b) elements
+	 * @return false if the block is corrupt
+	 */
+	bool decompressBlock(const size_t b, T* dst) const {
+		const size_t len = this->blockLength(b);
+		const size_t bytes = len*sizeof(T);
+		const Block &block = this->blocks[b];
+		if(block.raw) {
+			memcpy(dst, block.data.data(), bytes);
+			return true;
+		}
+		std::vector<uint8_t> shuffled(bytes);
+		if(codec::lz_decompress(block.data.data(), block.data.size(), shuffled.data(), bytes) != bytes)
+			return false;
+		codec::unshuffle(shuffled.data(), (uint8_t*)dst, len, sizeof(T));
+		return true;
+	}
+
+	/** Get the cache entry of the given block, decompressing it if necessary */
+	CacheEntry& load(const size_t b) const {
+		this->clock++;
+		for(size_t i=0;i<this->cache.size();i++) {
+			if(this->cache[i].block == b) {
+				this->cache[i].used = this->clock;
+				return this->cache[i];
+			}
+		}
+
+		size_t slot = this->cache.size();
+		if(this->cache.size() < this->cacheBlocks) {
+			this->cache.push_back(CacheEntry());
+		} else {
+			// Evict least recently used block
+			slot = 0;
+			for(size_t i=1;i<this->cache.size();i++)
+				if(this->cache[i].used < this->cache[slot].used) slot = i;
+			this->writeBack(this->cache[slot]);
+		}
+		CacheEntry &entry = this->cache[slot];
+		entry.block = b;
+		entry.val.resize(this->blockLength(b));
+		entry.dirty = false;
+		entry.used = this->clock;
+		if(!this->decompressBlock(b, entry.val.data())) {
+			this->cache.erase(this->cache.begin()+slot);
+			throw "Corrupt compressed block";
+		}
+		return entry;
+	}
+
+	/** Recompress a modified cache entry */
+	void writeBack(CacheEntry &entry) const {
+		if(!entry.dirty) return;
+		this->compressBlock(entry.block, entry.val.data(), entry.val.size());
+		entry.dirty = false;
+	}
+
+public:
+	/**
+	 * Create a new empty compressed array
+	 * @param blockSize Number of elements per compressed block
+	 * @param cacheBlocks Number of decompressed blocks kept in the block cache
+	 */
+	CompressedArray(const size_t blockSize = (32*1024)/sizeof(T), const size_t cacheBlocks = 4) :
+		n(0), blockSize(blockSize > 0 ? blockSize : 1), cacheBlocks(cacheBlocks > 0 ? cacheBlocks : 1), clock(0) {}
+	/** Create a compressed copy of the given array */
+	CompressedArray(const Array<T> &src, const size_t blockSize = (32*1024)/sizeof(T), const size_t cacheBlocks = 4) :
+		CompressedArray(blockSize, cacheBlocks) {
+		this->compress(src.data(), src.size());
+	}
+	virtual ~CompressedArray() {}
+
+	/** Number of elements */
+	size_t size() const { return this->n; }
+	/** Number of compressed blocks */
+	size_t blockCount() const { return this->blocks.size(); }
+	/** Memory in bytes used by the compressed blocks, excluding the block cache */
+	size_t compressedSize() const {
+		size_t ret = 0;
+		for(size_t b=0;b<this->blocks.size();b++)
+			ret += this->blocks[b].data.size();
+		return ret;
+	}
+	/** Uncompressed over compressed size */
+	double ratio() const {
+		const size_t bytes = this->compressedSize();
+		if(bytes == 0) return 1.0;
+		return (double)(this->n*sizeof(T)) / (double)bytes;
+	}
+
+	/** Replace the contents by the n given elements. Blocks are compressed in parallel */
+	void compress(const T* src, const size_t n) {
+		this->cache.clear();
+		this->n = n;
+		const long nBlocks = (long)((n + this->blockSize - 1) / this->blockSize);
+		this->blocks.assign(nBlocks, Block());
+		#pragma omp parallel for schedule(dynamic)
+		for(long b=0;b<nBlocks;b++)
+			this->compressBlock(b, src+b*this->blockSize, this->blockLength(b));
+	}
+
+	/** Decompress all elements into dst, which must hold size() elements */
+	void decompress(T* dst) const {
+		this->flush();
+		const long nBlocks = (long)this->blocks.size();
+		bool ok = true;
+		#pragma omp parallel for schedule(dynamic)
+		for(long b=0;b<nBlocks;b++) {
+			if(!this->decompressBlock(b, dst+b*this->blockSize)) {
+				#pragma omp atomic write
+				ok = false;
+			}
+		}
+		if(!ok) throw "Corrupt compressed block";
+	}
+
+	/** Recompress all modified blocks in the block cache */
+	void flush() const {
+		for(size_t i=0;i<this->cache.size();i++)
+			this->writeBack(this->cache[i]);
+	}
+
+	/** Drop the block cache, recompressing modified blocks */
+	void release() const {
+		this->flush();
+		this->cache.clear();
+	}
+
+	/** Read element i, decompressing its block if not cached */
+	T operator[](const size_t i) const {
+		const CacheEntry &entry = this->load(i / this->blockSize);
+		return entry.val[i % this->blockSize];
+	}
+
+	/** Set element i. The block is recompressed on eviction or flush() */
+	void set(const size_t i, const T &value) {
+		CacheEntry &entry = this->load(i / this->blockSize);
+		entry.val[i % this->blockSize] = value;
+		entry.dirty = true;
+	}
+};
+
+
+/** Cube held in memory as compressed blocks, see CompressedArray */
+template <class T>
+class CompressedCube : public CompressedArray<T> {
+protected:
+	size_t dims[3];
+	size_t index(const size_t x, const size_t y, const size_t z) const { return dims[0]*dims[1]*z+y*dims[0]+x; }
+
+public:
+	/** Create a compressed copy of the given cube. By default a block holds whole x-y planes */
+	CompressedCube(const Cube<T> &src, const size_t blockSize = 0, const size_t cacheBlocks = 4) :
+		CompressedArray<T>(blockSize > 0 ? blockSize : defaultBlockSize(src.size(0), src.size(1)), cacheBlocks) {
+		for(int i=0;i<3;i++)
+			this->dims[i] = src.size(i);
+		this->compress(src.data(), src.size());
+	}
+
+	size_t size(const size_t i) const { return this->dims[i]; }
+	size_t size() const { return CompressedArray<T>::size(); }
+
+	using CompressedArray<T>::set;
+	T operator()(const size_t i, const size_t j, const size_t k) const { return (*this)[index(i,j,k)]; }
+	void set(const size_t i, const size_t j, const size_t k, const T &value) { CompressedArray<T>::set(index(i,j,k), value); }
+
+	/** Decompress into a new cube */
+	Cube<T> cube() const {
+		Cube<T> ret(dims[0], dims[1], dims[2]);
+		this->decompress(ret.data());
+		return ret;
+	}
+
+	/** Block size holding as many whole x-y planes as fit into 32 KiB, but at least one */
+	static size_t defaultBlockSize(const size_t nx, const size_t ny) {
+		const size_t plane = nx*ny;
+		if(plane == 0) return 1;
+		const size_t planes = (32*1024)/sizeof(T)/plane;
+		return plane * (planes > 0 ? planes : 1);
+	}
+};
+
+}
+
+#endif
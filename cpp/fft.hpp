@@ -0,0 +1,554 @@
+/* =============================================================================
+ *
+ * Title:       Fast Fourier transforms
+ * Author:      Felix Niederwanger
+ * License:     MIT (http://opensource.org/licenses/MIT)
+ * Description: Mixed-radix complex and real FFTs with precomputed plans and
+ *              multithreaded 1D/2D/3D transforms on Array, Matrix and Cube.
+ *              Forward transforms are unnormalized, inverse transforms are
+ *              scaled by 1/n.
+ *              Standalone header file
+ * =============================================================================
+ */
+
+#ifndef _NUMERIC_FFT_HPP_
+#define _NUMERIC_FFT_HPP_
+
+#include <math.h>
+#include <string.h>
+
+#include <complex>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "numeric.hpp"
+
+namespace numeric {
+
+/**
+ * Precomputed plan for complex FFTs of length n. The length is factorized into radix 4, 2,
+ * 3 and 5 stages with specialized butterflies, other small prime factors use a generic
+ * O(p^2) butterfly. Stages run as Stockham autosort passes, so no bit reversal is required.
+ * Lengths with a prime factor above 31 are computed as a convolution (Bluestein) with a
+ * power of two transform. A plan is immutable after construction and can be shared
+ * between threads
+ */
+template <class T>
+class FFTPlan {
+public:
+	typedef std::complex<T> complex;
+
+protected:
+	struct Stage {
+		size_t radix, m, stride;
+		/** Offset of the stage twiddles w^(j*k), j < m, 0 < k < radix */
+		size_t twiddle;
+		/** Offset of the radix roots of unity for the generic butterfly */
+		size_t root;
+	};
+
+	size_t n;
+	size_t maxRadix;
+	std::vector<Stage> stages;
+	std::vector<complex> twiddles;
+	std::vector<complex> roots;
+	/** Power of two plan of the Bluestein convolution, if used */
+	std::shared_ptr<const FFTPlan<T>> inner;
+	/** Bluestein chirp e^(-i pi j^2/n) */
+	std::vector<complex> chirp;
+	/** Transformed convolution kernel of the Bluestein algorithm */
+	std::vector<complex> kernel;
+
+	/** Complex multiplication without the NaN handling of std::complex */
+	static inline complex mul(const complex &a, const complex &b) {
+		return complex(a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real());
+	}
+	/** Multiplication by -i */
+	static inline complex mulmi(const complex &a) { return complex(a.imag(), -a.real()); }
+
+	void radix2(const Stage &st, const complex* x, complex* y) const {
+		const size_t m = st.m, s = st.stride;
+		const complex* tw = &this->twiddles[st.twiddle];
+		for(size_t j=0;j<m;j++) {
+			const complex w = tw[j];
+			const complex* x0 = x + s*j;
+			const complex* x1 = x + s*(j+m);
+			complex* y0 = y + s*(2*j);
+			complex* y1 = y0 + s;
+			for(size_t q=0;q<s;q++) {
+				const complex a = x0[q], b = x1[q];
+				y0[q] = a + b;
+				y1[q] = mul(a - b, w);
+			}
+		}
+	}
+
+	void radix3(const Stage &st, const complex* x, complex* y) const {
+		const size_t m = st.m, s = st.stride;
+		const complex* tw = &this->twiddles[st.twiddle];
+		const T h = T(-0.86602540378443864676);
+		for(size_t j=0;j<m;j++) {
+			const complex w1 = tw[2*j], w2 = tw[2*j+1];
+			const complex* x0 = x + s*j;
+			const complex* x1 = x + s*(j+m);
+			const complex* x2 = x + s*(j+2*m);
+			complex* y0 = y + s*(3*j);
+			complex* y1 = y0 + s;
+			complex* y2 = y1 + s;
+			for(size_t q=0;q<s;q++) {
+				const complex a0 = x0[q], a1 = x1[q], a2 = x2[q];
+				const complex t1 = a1 + a2;
+				const complex t2 = a0 - T(0.5)*t1;
+				const complex d = a1 - a2;
+				const complex t3(-h*d.imag(), h*d.real());
+				y0[q] = a0 + t1;
+				y1[q] = mul(t2 + t3, w1);
+				y2[q] = mul(t2 - t3, w2);
+			}
+		}
+	}
+
+	void radix4(const Stage &st, const complex* x, complex* y) const {
+		const size_t m = st.m, s = st.stride;
+		const complex* tw = &this->twiddles[st.twiddle];
+		for(size_t j=0;j<m;j++) {
+			const complex w1 = tw[3*j], w2 = tw[3*j+1], w3 = tw[3*j+2];
+			const complex* x0 = x + s*j;
+			const complex* x1 = x + s*(j+m);
+			const complex* x2 = x + s*(j+2*m);
+			const complex* x3 = x + s*(j+3*m);
+			complex* y0 = y + s*(4*j);
+			complex* y1 = y0 + s;
+			complex* y2 = y1 + s;
+			complex* y3 = y2 + s;
+			for(size_t q=0;q<s;q++) {
+				const complex a0 = x0[q], a1 = x1[q], a2 = x2[q], a3 = x3[q];
+				const complex t0 = a0 + a2, t1 = a0 - a2;
+				const complex t2 = a1 + a3, t3 = mulmi(a1 - a3);
+				y0[q] = t0 + t2;
+				y1[q] = mul(t1 + t3, w1);
+				y2[q] = mul(t0 - t2, w2);
+				y3[q] = mul(t1 - t3, w3);
+			}
+		}
+	}
+
+	void radix5(const Stage &st, const complex* x, complex* y) const {
+		const size_t m = st.m, s = st.stride;
+		const complex* tw = &this->twiddles[st.twiddle];
+		const T c1 = T(0.30901699437494742410), c2 = T(-0.80901699437494742410);
+		const T s1 = T(0.95105651629515357212), s2 = T(0.58778525229247312917);
+		for(size_t j=0;j<m;j++) {
+			const complex w1 = tw[4*j], w2 = tw[4*j+1], w3 = tw[4*j+2], w4 = tw[4*j+3];
+			for(size_t q=0;q<s;q++) {
+				const complex a0 = x[q + s*j], a1 = x[q + s*(j+m)], a2 = x[q + s*(j+2*m)], a3 = x[q + s*(j+3*m)], a4 = x[q + s*(j+4*m)];
+				const complex b1 = a1 + a4, b2 = a2 + a3, d1 = a1 - a4, d2 = a2 - a3;
+				const complex t1 = a0 + c1*b1 + c2*b2, t2 = a0 + c2*b1 + c1*b2;
+				const complex u1 = mulmi(s1*d1 + s2*d2), u2 = mulmi(s2*d1 - s1*d2);
+				complex* y0 = y + q + s*(5*j);
+				y0[0] = a0 + b1 + b2;
+				y0[s] = mul(t1 + u1, w1);
+				y0[2*s] = mul(t2 + u2, w2);
+				y0[3*s] = mul(t2 - u2, w3);
+				y0[4*s] = mul(t1 - u1, w4);
+			}
+		}
+	}
+
+	/** Transform via the convolution of the chirp-modulated input with the conjugate chirp */
+	void bluestein(const complex* in, complex* out, complex* work, const bool inverse) const {
+		const size_t len = this->inner->size();
+		complex* a = work;
+		for(size_t j=0;j<this->n;j++) a[j] = mul(inverse ? std::conj(in[j]) : in[j], this->chirp[j]);
+		for(size_t j=this->n;j<len;j++) a[j] = 0;
+		this->inner->execute(a, a, work + len);
+		for(size_t j=0;j<len;j++) a[j] = mul(a[j], this->kernel[j]);
+		this->inner->execute(a, a, work + len, true);
+		const T scale = inverse ? T(1)/T(this->n) : T(1);
+		for(size_t k=0;k<this->n;k++) {
+			const complex v = mul(a[k], this->chirp[k]);
+			out[k] = inverse ? scale*std::conj(v) : v;
+		}
+	}
+
+	void generic(const Stage &st, const complex* x, complex* y, complex* scratch) const {
+		const size_t m = st.m, s = st.stride, p = st.radix;
+		const complex* tw = &this->twiddles[st.twiddle];
+		const complex* root = &this->roots[st.root];
+		for(size_t j=0;j<m;j++) {
+			for(size_t q=0;q<s;q++) {
+				for(size_t r=0;r<p;r++) scratch[r] = x[q + s*(j + r*m)];
+				for(size_t k=0;k<p;k++) {
+					complex sum = scratch[0];
+					for(size_t r=1, e=k;r<p;r++, e=(e+k)%p) sum += mul(scratch[r], root[e]);
+					y[q + s*(p*j + k)] = (k == 0) ? sum : mul(sum, tw[j*(p-1) + k-1]);
+				}
+			}
+		}
+	}
+
+public:
+	FFTPlan(const size_t n) : n(n), maxRadix(1) {
+		if(n == 0) throw "Illegal FFT length";
+		std::vector<size_t> factors;
+		size_t rem = n;
+		while(rem % 4 == 0) { factors.push_back(4); rem /= 4; }
+		while(rem % 2 == 0) { factors.push_back(2); rem /= 2; }
+		for(size_t p=3;p<=rem;p+=2) {
+			while(rem % p == 0) { factors.push_back(p); rem /= p; }
+		}
+		if(!factors.empty() && factors.back() > 31) {
+			size_t len = 1;
+			while(len < 2*n-1) len *= 2;
+			this->inner = std::make_shared<const FFTPlan<T>>(len);
+			for(size_t j=0;j<n;j++) {
+				// j^2 mod 2n keeps the phase accurate for large j
+				const double phi = -M_PI*(double)((j*j) % (2*n))/(double)n;
+				this->chirp.push_back(complex(T(cos(phi)), T(sin(phi))));
+			}
+			this->kernel.assign(len, complex(0));
+			for(size_t j=0;j<n;j++) {
+				this->kernel[j] = std::conj(this->chirp[j]);
+				if(j > 0) this->kernel[len-j] = std::conj(this->chirp[j]);
+			}
+			std::vector<complex> work(this->inner->workSize());
+			this->inner->execute(this->kernel.data(), this->kernel.data(), work.data());
+			return;
+		}
+
+		size_t len = n, stride = 1;
+		for(size_t f=0;f<factors.size();f++) {
+			Stage st;
+			st.radix = factors[f];
+			st.m = len / st.radix;
+			st.stride = stride;
+			st.twiddle = this->twiddles.size();
+			st.root = this->roots.size();
+			for(size_t j=0;j<st.m;j++) {
+				for(size_t k=1;k<st.radix;k++) {
+					const double phi = -2.0*M_PI*(double)(j*k)/(double)len;
+					this->twiddles.push_back(complex(T(cos(phi)), T(sin(phi))));
+				}
+			}
+			if(st.radix > 5) {
+				for(size_t k=0;k<st.radix;k++) {
+					const double phi = -2.0*M_PI*(double)k/(double)st.radix;
+					this->roots.push_back(complex(T(cos(phi)), T(sin(phi))));
+				}
+			}
+			if(st.radix > this->maxRadix) this->maxRadix = st.radix;
+			this->stages.push_back(st);
+			len = st.m;
+			stride *= st.radix;
+		}
+	}
+
+	/** Transform length */
+	size_t size() const { return this->n; }
+	/** Number of complex elements the work buffer of execute() must hold */
+	size_t workSize() const {
+		if(this->inner) return this->inner->size() + this->inner->workSize();
+		return this->n + this->maxRadix;
+	}
+
+	/**
+	 * Transform n elements from in to out. in and out may be the same buffer, work
+	 * must hold workSize() elements and must not overlap with in or out
+	 */
+	void execute(const complex* in, complex* out, complex* work, const bool inverse = false) const {
+		if(this->inner) {
+			this->bluestein(in, out, work, inverse);
+			return;
+		}
+		// Ping-pong between out and work such that the last stage writes to out
+		complex* x = (this->stages.size() % 2 == 0) ? out : work;
+		complex* y = (x == out) ? work : out;
+		if(inverse) {
+			for(size_t i=0;i<this->n;i++) x[i] = std::conj(in[i]);
+		} else if(x != in)
+			memcpy((void*)x, (const void*)in, this->n*sizeof(complex));
+		complex* scratch = work + this->n;
+		for(size_t s=0;s<this->stages.size();s++) {
+			const Stage &st = this->stages[s];
+			switch(st.radix) {
+				case 2: this->radix2(st, x, y); break;
+				case 3: this->radix3(st, x, y); break;
+				case 4: this->radix4(st, x, y); break;
+				case 5: this->radix5(st, x, y); break;
+				default: this->generic(st, x, y, scratch); break;
+			}
+			complex* tmp = x;
+			x = y;
+			y = tmp;
+		}
+		if(inverse) {
+			const T scale = T(1)/T(this->n);
+			for(size_t i=0;i<this->n;i++) out[i] = scale*std::conj(out[i]);
+		}
+	}
+
+	/** Transform n elements in place, allocating the work buffer */
+	void execute(complex* data, const bool inverse = false) const {
+		std::vector<complex> work(this->workSize());
+		this->execute(data, data, work.data(), inverse);
+	}
+};
+
+/**
+ * Precomputed plan for FFTs of n real values, producing the n/2+1 non-redundant
+ * coefficients. Even lengths run as a complex FFT of length n/2
+ */
+template <class T>
+class RealFFTPlan {
+public:
+	typedef std::complex<T> complex;
+
+protected:
+	size_t n;
+	FFTPlan<T> plan;
+	/** e^(-2 pi i k/n) for k <= n/2 */
+	std::vector<complex> w;
+
+public:
+	RealFFTPlan(const size_t n) : n(n), plan((n % 2 == 0 && n > 0) ? n/2 : n) {
+		if(n % 2 == 0) {
+			for(size_t k=0;k<=n/2;k++) {
+				const double phi = -2.0*M_PI*(double)k/(double)n;
+				this->w.push_back(complex(T(cos(phi)), T(sin(phi))));
+			}
+		}
+	}
+
+	/** Transform length */
+	size_t size() const { return this->n; }
+	/** Number of coefficients of the transform */
+	size_t spectrumSize() const { return this->n/2 + 1; }
+	/** Number of complex elements the work buffer must hold */
+	size_t workSize() const { return this->plan.size() + this->plan.workSize(); }
+
+	/** Transform n real values from in into n/2+1 coefficients in out */
+	void forward(const T* in, complex* out, complex* work) const {
+		const size_t len = this->plan.size();
+		complex* z = work;
+		if(this->n % 2 != 0) {
+			for(size_t i=0;i<len;i++) z[i] = complex(in[i], 0);
+			this->plan.execute(z, z, work + len);
+			for(size_t k=0;k<=this->n/2;k++) out[k] = z[k];
+			return;
+		}
+		// Pack even and odd values into one complex sequence and separate the spectra afterwards
+		for(size_t i=0;i<len;i++) z[i] = complex(in[2*i], in[2*i+1]);
+		this->plan.execute(z, z, work + len);
+		for(size_t k=0;k<=len;k++) {
+			const complex a = z[k % len], b = std::conj(z[(len-k) % len]);
+			const complex even = T(0.5)*(a + b);
+			const complex d = T(0.5)*(a - b);
+			const complex odd(d.imag(), -d.real());
+			const complex wk = this->w[k];
+			out[k] = even + complex(wk.real()*odd.real() - wk.imag()*odd.imag(), wk.real()*odd.imag() + wk.imag()*odd.real());
+		}
+	}
+
+	/** Inverse transform of n/2+1 coefficients into n real values, scaled by 1/n */
+	void inverse(const complex* in, T* out, complex* work) const {
+		const size_t len = this->plan.size();
+		complex* z = work;
+		if(this->n % 2 != 0) {
+			for(size_t k=0;k<=this->n/2;k++) z[k] = in[k];
+			for(size_t k=this->n/2+1;k<this->n;k++) z[k] = std::conj(in[this->n-k]);
+			this->plan.execute(z, z, work + len, true);
+			for(size_t i=0;i<len;i++) out[i] = z[i].real();
+			return;
+		}
+		for(size_t k=0;k<len;k++) {
+			const complex a = in[k], b = std::conj(in[len-k]);
+			const complex even = T(0.5)*(a + b);
+			const complex d = T(0.5)*(a - b);
+			const complex wk = std::conj(this->w[k]);
+			const complex odd(wk.real()*d.real() - wk.imag()*d.imag(), wk.real()*d.imag() + wk.imag()*d.real());
+			z[k] = complex(even.real() - odd.imag(), even.imag() + odd.real());
+		}
+		this->plan.execute(z, z, work + len, true);
+		for(size_t i=0;i<len;i++) {
+			out[2*i] = z[i].real();
+			out[2*i+1] = z[i].imag();
+		}
+	}
+};
+
+/**
+ * Plan of type P (FFTPlan or RealFFTPlan) for length n from a process-wide cache, so that
+ * repeated transforms of the same length through fft(), rfft() and irfft() build their
+ * plans only once. Plans cover both directions. The cache keeps up to 32 lengths per plan
+ * type; evicted plans stay valid as long as they are in use
+ */
+template <class P>
+std::shared_ptr<const P> sharedPlan(const size_t n) {
+	static std::mutex mutex;
+	static std::map<size_t, std::shared_ptr<const P>> plans;
+	std::lock_guard<std::mutex> lock(mutex);
+	typename std::map<size_t, std::shared_ptr<const P>>::iterator it = plans.find(n);
+	if(it != plans.end()) return it->second;
+	if(plans.size() >= 32) plans.erase(plans.begin());
+	std::shared_ptr<const P> plan = std::make_shared<const P>(n);
+	plans[n] = plan;
+	return plan;
+}
+
+/**
+ * Transform all lines along one axis of a complex array with the given dimensions (first
+ * dimension fastest) in place. Lines run in parallel; strided lines are gathered in
+ * groups of adjacent lines so that whole cache lines are used
+ */
+template <class T>
+void fftAxis(std::complex<T>* data, const size_t* dims, const int rank, const int axis, const bool inverse = false) {
+	typedef std::complex<T> complex;
+	const size_t n = dims[axis];
+	if(n <= 1) return;
+	size_t inner = 1, outer = 1;
+	for(int d=0;d<axis;d++) inner *= dims[d];
+	for(int d=axis+1;d<rank;d++) outer *= dims[d];
+	const std::shared_ptr<const FFTPlan<T>> plan = sharedPlan<FFTPlan<T>>(n);
+	const size_t group = (inner == 1) ? 1 : 8;
+	const size_t groups = (inner + group - 1) / group;
+
+	#pragma omp parallel
+	{
+		std::vector<complex> work(plan->workSize());
+		std::vector<complex> lines((inner == 1) ? 0 : group*n);
+		#pragma omp for schedule(static)
+		for(long g=0;g<(long)(groups*outer);g++) {
+			const size_t o = g / groups;
+			const size_t i0 = (g % groups) * group;
+			complex* base = data + o*inner*n + i0;
+			if(inner == 1) {
+				plan->execute(base, base, work.data(), inverse);
+				continue;
+			}
+			const size_t count = (i0 + group <= inner) ? group : inner - i0;
+			for(size_t t=0;t<n;t++)
+				for(size_t c=0;c<count;c++) lines[c*n + t] = base[t*inner + c];
+			for(size_t c=0;c<count;c++) plan->execute(&lines[c*n], &lines[c*n], work.data(), inverse);
+			for(size_t t=0;t<n;t++)
+				for(size_t c=0;c<count;c++) base[t*inner + c] = lines[c*n + t];
+		}
+	}
+}
+
+/** Real to complex transform along the first dimension: lines of n real values to n/2+1 coefficients */
+template <class T>
+void rfftLines(const T* in, std::complex<T>* out, const size_t n, const size_t lines) {
+	const std::shared_ptr<const RealFFTPlan<T>> plan = sharedPlan<RealFFTPlan<T>>(n);
+	const size_t m = plan->spectrumSize();
+	#pragma omp parallel
+	{
+		std::vector<std::complex<T>> work(plan->workSize());
+		#pragma omp for schedule(static)
+		for(long l=0;l<(long)lines;l++) plan->forward(in + l*n, out + l*m, work.data());
+	}
+}
+
+/** Complex to real transform along the first dimension, inverse of rfftLines */
+template <class T>
+void irfftLines(const std::complex<T>* in, T* out, const size_t n, const size_t lines) {
+	const std::shared_ptr<const RealFFTPlan<T>> plan = sharedPlan<RealFFTPlan<T>>(n);
+	const size_t m = plan->spectrumSize();
+	#pragma omp parallel
+	{
+		std::vector<std::complex<T>> work(plan->workSize());
+		#pragma omp for schedule(static)
+		for(long l=0;l<(long)lines;l++) plan->inverse(in + l*m, out + l*n, work.data());
+	}
+}
+
+/** In-place complex FFT of an Array */
+template <class T>
+void fft(Array<std::complex<T>> &a, const bool inverse = false) {
+	const size_t dims[1] = {a.size()};
+	fftAxis(a.data(), dims, 1, 0, inverse);
+}
+
+/** In-place two-dimensional complex FFT of a Matrix */
+template <class T>
+void fft(Matrix<std::complex<T>> &m, const bool inverse = false) {
+	const size_t dims[2] = {m.size(0), m.size(1)};
+	std::complex<T>* data = m.data();
+	for(int axis=0;axis<2;axis++) fftAxis(data, dims, 2, axis, inverse);
+}
+
+/** In-place three-dimensional complex FFT of a Cube */
+template <class T>
+void fft(Cube<std::complex<T>> &c, const bool inverse = false) {
+	const size_t dims[3] = {c.size(0), c.size(1), c.size(2)};
+	std::complex<T>* data = c.data();
+	for(int axis=0;axis<3;axis++) fftAxis(data, dims, 3, axis, inverse);
+}
+
+/** FFT of a real Array, returns the n/2+1 non-redundant coefficients */
+template <class T>
+Array<std::complex<T>> rfft(const Array<T> &a) {
+	Array<std::complex<T>> result(a.size()/2 + 1);
+	rfftLines(a.data(), result.data(), a.size(), 1);
+	return result;
+}
+
+/** Two-dimensional FFT of a real Matrix. The result has size(0)/2+1 columns in the first dimension */
+template <class T>
+Matrix<std::complex<T>> rfft(const Matrix<T> &m) {
+	Matrix<std::complex<T>> result(m.size(0)/2 + 1, m.size(1));
+	const size_t dims[2] = {result.size(0), result.size(1)};
+	rfftLines(m.data(), result.data(), m.size(0), m.size(1));
+	fftAxis(result.data(), dims, 2, 1);
+	return result;
+}
+
+/** Three-dimensional FFT of a real Cube. The result has size(0)/2+1 values in the first dimension */
+template <class T>
+Cube<std::complex<T>> rfft(const Cube<T> &c) {
+	Cube<std::complex<T>> result(c.size(0)/2 + 1, c.size(1), c.size(2));
+	const size_t dims[3] = {result.size(0), result.size(1), result.size(2)};
+	rfftLines(c.data(), result.data(), c.size(0), c.size(1)*c.size(2));
+	std::complex<T>* data = result.data();
+	for(int axis=1;axis<3;axis++) fftAxis(data, dims, 3, axis);
+	return result;
+}
+
+/** Inverse of rfft for an Array of n real values */
+template <class T>
+Array<T> irfft(const Array<std::complex<T>> &a, const size_t n) {
+	if(a.size() != n/2 + 1) throw "Spectrum size mismatch";
+	Array<T> result(n);
+	irfftLines(a.data(), result.data(), n, 1);
+	return result;
+}
+
+/** Inverse of rfft for a Matrix with n values in the first dimension */
+template <class T>
+Matrix<T> irfft(const Matrix<std::complex<T>> &m, const size_t n) {
+	if(m.size(0) != n/2 + 1) throw "Spectrum size mismatch";
+	Matrix<std::complex<T>> spectrum(m);
+	const size_t dims[2] = {spectrum.size(0), spectrum.size(1)};
+	fftAxis(spectrum.data(), dims, 2, 1, true);
+	Matrix<T> result(n, m.size(1));
+	irfftLines(spectrum.data(), result.data(), n, m.size(1));
+	return result;
+}
+
+/** Inverse of rfft for a Cube with n values in the first dimension */
+template <class T>
+Cube<T> irfft(const Cube<std::complex<T>> &c, const size_t n) {
+	if(c.size(0) != n/2 + 1) throw "Spectrum size mismatch";
+	Cube<std::complex<T>> spectrum(c);
+	const size_t dims[3] = {spectrum.size(0), spectrum.size(1), spectrum.size(2)};
+	std::complex<T>* data = spectrum.data();
+	for(int axis=2;axis>0;axis--) fftAxis(data, dims, 3, axis, true);
+	Cube<T> result(n, c.size(1), c.size(2));
+	irfftLines(data, result.data(), n, c.size(1)*c.size(2));
+	return result;
+}
+
+}
+
+#endif
@@ -0,0 +1,183 @@
+/* =============================================================================
+ *
+ * Title:       Separable convolution filters
+ * Author:      Felix Niederwanger
+ * License:     MIT (http://opensource.org/licenses/MIT)
+ * Description: One-dimensional convolutions along the axes of Matrix and Cube
+ *              data and binomial/Gaussian smoothing built on them, so an
+ *              N^3 kernel costs 3N operations per cell.
+ *              Standalone header file
+ * =============================================================================
+ */
+
+#ifndef _NUMERIC_FILTER_HPP_
+#define _NUMERIC_FILTER_HPP_
+
+#include <math.h>
+
+#include <vector>
+
+#include "numeric.hpp"
+
+namespace numeric {
+
+/** How values outside of the data are obtained when filtering */
+enum Padding {
+	PADDING_PERIODIC = 0,
+	PADDING_ZERO = 1,
+	/** Repeat the outermost value */
+	PADDING_CLAMP = 2
+};
+
+/** Normalized binomial kernel of the given (even) order, e.g. order 2 is (1,2,1)/4 */
+template <class T>
+std::vector<T> binomialKernel(const size_t order = 2) {
+	if(order % 2 != 0) throw "Binomial kernel order must be even";
+	std::vector<double> c(order+1, 0.0);
+	c[0] = 1.0;
+	for(size_t i=1;i<=order;i++)
+		for(size_t j=i;j>0;j--) c[j] += c[j-1];
+	const double norm = pow(2.0, (double)order);
+	std::vector<T> kernel(order+1);
+	for(size_t i=0;i<=order;i++) kernel[i] = T(c[i]/norm);
+	return kernel;
+}
+
+/** Normalized Gaussian kernel with the given standard deviation in cells. The default radius is ceil(3 sigma) */
+template <class T>
+std::vector<T> gaussianKernel(const double sigma, size_t radius = 0) {
+	if(sigma <= 0) throw "Illegal Gaussian width";
+	if(radius == 0) radius = (size_t)ceil(3.0*sigma);
+	std::vector<double> c(2*radius+1);
+	double sum = 0;
+	for(size_t i=0;i<c.size();i++) {
+		const double x = (double)i - (double)radius;
+		c[i] = exp(-0.5*x*x/(sigma*sigma));
+		sum += c[i];
+	}
+	std::vector<T> kernel(c.size());
+	for(size_t i=0;i<c.size();i++) kernel[i] = T(c[i]/sum);
+	return kernel;
+}
+
+/** Source index of position i of a line of length n, or -1 for a zero value */
+static inline long paddedIndex(const long i, const long n, const Padding padding) {
+	if(i >= 0 && i < n) return i;
+	switch(padding) {
+		case PADDING_PERIODIC: return ((i % n) + n) % n;
+		case PADDING_CLAMP: return (i < 0) ? 0 : n-1;
+		default: return -1;
+	}
+}
+
+/**
+ * Convolve all lines along one axis of data with the given dimensions (first dimension
+ * fastest) in place: out[i] = sum_t kernel[t]*in[i-t+r] with r = kernel.size()/2, so an
+ * impulse reproduces the kernel in order. Symmetric kernels give the same result as a
+ * correlation. Each line is copied into a padded buffer first. Lines along strided axes are
+ * processed in blocks of adjacent lines, so the innermost loop runs over contiguous memory
+ */
+template <class T>
+void convolveAxis(T* data, const size_t* dims, const int rank, const int axis, const std::vector<T> &kernel, const Padding padding = PADDING_PERIODIC) {
+	if(kernel.size() % 2 == 0) throw "Kernel size must be odd";
+	const size_t n = dims[axis];
+	const size_t r = kernel.size()/2;
+	const size_t len = kernel.size();
+	// The loops below correlate, with the reversed kernel this is the convolution
+	const std::vector<T> reversed(kernel.rbegin(), kernel.rend());
+	const T* k = reversed.data();
+	if(n == 0) return;
+	size_t inner = 1, outer = 1;
+	for(int d=0;d<axis;d++) inner *= dims[d];
+	for(int d=axis+1;d<rank;d++) outer *= dims[d];
+	const size_t block = (inner == 1) ? 1 : ((inner < 64) ? inner : 64);
+	const size_t blocks = (inner + block - 1) / block;
+
+	#pragma omp parallel
+	{
+		std::vector<T> buffer((n + 2*r) * block);
+		std::vector<T> acc(block);
+		T* buf = buffer.data();
+		#pragma omp for schedule(static)
+		for(long b=0;b<(long)(blocks*outer);b++) {
+			const size_t o = b / blocks;
+			const size_t c0 = (b % blocks) * block;
+			const size_t count = (c0 + block <= inner) ? block : inner - c0;
+			T* base = data + o*inner*n + c0;
+			// Fill the padded line buffer
+			for(size_t p=0;p<n+2*r;p++) {
+				const long src = paddedIndex((long)p - (long)r, (long)n, padding);
+				T* dst = buf + p*block;
+				if(src < 0) {
+					for(size_t c=0;c<count;c++) dst[c] = T(0);
+				} else {
+					const T* s = base + src*inner;
+					for(size_t c=0;c<count;c++) dst[c] = s[c];
+				}
+			}
+			if(inner == 1) {
+				for(size_t i=0;i<n;i++) base[i] = T(0);
+				for(size_t t=0;t<len;t++) {
+					const T w = k[t];
+					const T* src = buf + t;
+					#pragma omp simd
+					for(size_t i=0;i<n;i++) base[i] += w*src[i];
+				}
+			} else {
+				T* a = acc.data();
+				for(size_t i=0;i<n;i++) {
+					for(size_t c=0;c<count;c++) a[c] = T(0);
+					for(size_t t=0;t<len;t++) {
+						const T w = k[t];
+						const T* src = buf + (i+t)*block;
+						#pragma omp simd
+						for(size_t c=0;c<count;c++) a[c] += w*src[c];
+					}
+					T* dst = base + i*inner;
+					for(size_t c=0;c<count;c++) dst[c] = a[c];
+				}
+			}
+		}
+	}
+}
+
+/** Convolve a Matrix with the kernel kx along the first and ky along the second dimension */
+template <class T>
+void convolve(Matrix<T> &m, const std::vector<T> &kx, const std::vector<T> &ky, const Padding padding = PADDING_PERIODIC) {
+	const size_t dims[2] = {m.size(0), m.size(1)};
+	T* data = m.data();
+	convolveAxis(data, dims, 2, 0, kx, padding);
+	convolveAxis(data, dims, 2, 1, ky, padding);
+}
+
+/** Convolve a Cube with the kernels kx, ky and kz along the three dimensions */
+template <class T>
+void convolve(Cube<T> &c, const std::vector<T> &kx, const std::vector<T> &ky, const std::vector<T> &kz, const Padding padding = PADDING_PERIODIC) {
+	const size_t dims[3] = {c.size(0), c.size(1), c.size(2)};
+	T* data = c.data();
+	convolveAxis(data, dims, 3, 0, kx, padding);
+	convolveAxis(data, dims, 3, 1, ky, padding);
+	convolveAxis(data, dims, 3, 2, kz, padding);
+}
+
+/** Convolve a Cube with the same kernel along all dimensions */
+template <class T>
+void convolve(Cube<T> &c, const std::vector<T> &kernel, const Padding padding = PADDING_PERIODIC) {
+	convolve(c, kernel, kernel, kernel, padding);
+}
+
+/** Binomial smoothing of the given order along all dimensions */
+template <class T>
+void smoothBinomial(Cube<T> &c, const size_t order = 2, const Padding padding = PADDING_PERIODIC) {
+	convolve(c, binomialKernel<T>(order), padding);
+}
+
+/** Gaussian smoothing with the given width in cells along all dimensions */
+template <class T>
+void smoothGaussian(Cube<T> &c, const double sigma, const Padding padding = PADDING_PERIODIC) {
+	convolve(c, gaussianKernel<T>(sigma), padding);
+}
+
+}
+
+#endif
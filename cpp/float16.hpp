@@ -0,0 +1,312 @@
+/* =============================================================================
+ *
+ * Title:       Reduced precision floating point storage types
+ * Author:      Felix Niederwanger
+ * License:     MIT (http://opensource.org/licenses/MIT)
+ * Description: IEEE half precision (float16) and bfloat16 storage types for the
+ *              numeric containers, and bulk conversion kernels from and to
+ *              float and double. The kernels use F16C/AVX2/AVX-512 if the
+ *              compiler targets these instruction sets, otherwise scalar code.
+ *              Standalone header file
+ * =============================================================================
+ */
+
+#ifndef _NUMERIC_FLOAT16_HPP_
+#define _NUMERIC_FLOAT16_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "numeric.hpp"
+
+#if defined(__F16C__) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace numeric {
+
+/**
+ * IEEE 754 half precision (binary16) storage type.
+ * Arithmetic is done in float, the type is only meant for storage. The all-zero
+ * bit pattern is 0.0, so calloc/bzero initialisation of the containers holds.
+ */
+class float16 {
+protected:
+	uint16_t bits;
+
+public:
+	float16() : bits(0) {}
+	float16(const float f) : bits(fromFloat(f)) {}
+	/** Conversion from double goes via float and might thus round twice */
+	float16(const double d) : bits(fromFloat((float)d)) {}
+	float16(const int i) : bits(fromFloat((float)i)) {}
+
+	operator float() const { return toFloat(this->bits); }
+
+	float16& operator+=(const float f) { this->bits = fromFloat(toFloat(this->bits) + f); return *this; }
+	float16& operator-=(const float f) { this->bits = fromFloat(toFloat(this->bits) - f); return *this; }
+	float16& operator*=(const float f) { this->bits = fromFloat(toFloat(this->bits) * f); return *this; }
+	float16& operator/=(const float f) { this->bits = fromFloat(toFloat(this->bits) / f); return *this; }
+
+	/** @return the raw bit pattern */
+	uint16_t raw() const { return this->bits; }
+	/** Create a value from the given raw bit pattern */
+	static float16 fromRaw(const uint16_t bits) {
+		float16 ret;
+		ret.bits = bits;
+		return ret;
+	}
+
+	/** Convert float to half precision bits, rounding to nearest even */
+	static uint16_t fromFloat(const float f) {
+		const uint32_t f32infty = 255U << 23;
+		const uint32_t f16max = (127U + 16U) << 23;
+		const uint32_t denorm_magic = ((127U - 15U) + (23U - 10U) + 1U) << 23;
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+		const uint32_t sign = x & 0x80000000U;
+		x ^= sign;
+
+		uint16_t ret;
+		if(x >= f16max) {
+			// Overflow to infinity. NaN is quieted and keeps the upper payload bits, like VCVTPS2PH
+			ret = (x > f32infty) ? (uint16_t)(0x7E00U | ((x >> 13) & 0x3FFU)) : 0x7C00;
+		} else if(x < (113U << 23)) {
+			// Subnormal or zero: Let the FPU do the rounding
+			float fx, magic;
+			memcpy(&fx, &x, sizeof(fx));
+			memcpy(&magic, &denorm_magic, sizeof(magic));
+			fx += magic;
+			memcpy(&x, &fx, sizeof(x));
+			ret = (uint16_t)(x - denorm_magic);
+		} else {
+			const uint32_t mant_odd = (x >> 13) & 1U;
+			x += ((uint32_t)(15 - 127) << 23) + 0xFFFU;
+			x += mant_odd;
+			ret = (uint16_t)(x >> 13);
+		}
+		return (uint16_t)(ret | (sign >> 16));
+	}
+
+	/** Convert half precision bits to float. This conversion is exact */
+	static float toFloat(const uint16_t h) {
+		const uint32_t shifted_exp = 0x7C00U << 13;
+		uint32_t x = ((uint32_t)h & 0x7FFFU) << 13;
+		const uint32_t exp = shifted_exp & x;
+		x += (uint32_t)(127 - 15) << 23;
+
+		float ret;
+		if(exp == shifted_exp) {
+			x += (uint32_t)(128 - 16) << 23;		// Inf/NaN
+			if(x & 0x7FFFFFU) x |= 0x400000U;		// Quiet NaN, like VCVTPH2PS
+			memcpy(&ret, &x, sizeof(ret));
+		} else if(exp == 0) {
+			// Subnormal: Renormalize via the FPU
+			const uint32_t magic_bits = 113U << 23;
+			float magic;
+			x += 1U << 23;
+			memcpy(&ret, &x, sizeof(ret));
+			memcpy(&magic, &magic_bits, sizeof(magic));
+			ret -= magic;
+		} else
+			memcpy(&ret, &x, sizeof(ret));
+
+		if(h & 0x8000U) ret = -ret;
+		return ret;
+	}
+};
+
+/**
+ * bfloat16 storage type, i.e. the upper half of a IEEE float.
+ * Same exponent range as float with 8 bits of precision. Arithmetic is done in float
+ */
+class bfloat16 {
+protected:
+	uint16_t bits;
+
+public:
+	bfloat16() : bits(0) {}
+	bfloat16(const float f) : bits(fromFloat(f)) {}
+	bfloat16(const double d) : bits(fromFloat((float)d)) {}
+	bfloat16(const int i) : bits(fromFloat((float)i)) {}
+
+	operator float() const { return toFloat(this->bits); }
+
+	bfloat16& operator+=(const float f) { this->bits = fromFloat(toFloat(this->bits) + f); return *this; }
+	bfloat16& operator-=(const float f) { this->bits = fromFloat(toFloat(this->bits) - f); return *this; }
+	bfloat16& operator*=(const float f) { this->bits = fromFloat(toFloat(this->bits) * f); return *this; }
+	bfloat16& operator/=(const float f) { this->bits = fromFloat(toFloat(this->bits) / f); return *this; }
+
+	/** @return the raw bit pattern */
+	uint16_t raw() const { return this->bits; }
+	/** Create a value from the given raw bit pattern */
+	static bfloat16 fromRaw(const uint16_t bits) {
+		bfloat16 ret;
+		ret.bits = bits;
+		return ret;
+	}
+
+	/** Convert float to bfloat16 bits, rounding to nearest even */
+	static uint16_t fromFloat(const float f) {
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+		if((x & 0x7FFFFFFFU) > 0x7F800000U)
+			return (uint16_t)((x >> 16) | 0x40U);		// Quiet NaN
+		x += 0x7FFFU + ((x >> 16) & 1U);
+		return (uint16_t)(x >> 16);
+	}
+
+	/** Convert bfloat16 bits to float. This conversion is exact */
+	static float toFloat(const uint16_t h) {
+		const uint32_t x = (uint32_t)h << 16;
+		float ret;
+		memcpy(&ret, &x, sizeof(ret));
+		return ret;
+	}
+};
+
+static_assert(sizeof(float16) == 2, "float16 must be a 16 bit type");
+static_assert(sizeof(bfloat16) == 2, "bfloat16 must be a 16 bit type");
+
+/** Container sums of the reduced precision types are accumulated in float */
+template <> struct numeric_traits<float16> { typedef float accum_type; };
+template <> struct numeric_traits<bfloat16> { typedef float accum_type; };
+
+#if defined(__AVX512F__)
+/**
+ * All-lanes mask. The kernels use the zero-masking forms of the AVX-512 intrinsics, because
+ * the unmasked ones start from an undefined register, which GCC reports as maybe uninitialized
+ */
+static const __mmask16 AVX512_ALL = 0xFFFF;
+#endif
+
+
+/** Convert n floats to half precision */
+inline void convert(const float* src, float16* dst, const size_t n) {
+	uint16_t* out = (uint16_t*)dst;
+	size_t i = 0;
+#if defined(__AVX512F__)
+	for(;i+16<=n;i+=16)
+		_mm256_storeu_si256((__m256i*)(out+i), _mm512_maskz_cvtps_ph(AVX512_ALL, _mm512_loadu_ps(src+i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+#if defined(__F16C__)
+	for(;i+8<=n;i+=8)
+		_mm_storeu_si128((__m128i*)(out+i), _mm256_cvtps_ph(_mm256_loadu_ps(src+i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+	for(;i<n;i++)
+		out[i] = float16::fromFloat(src[i]);
+}
+
+/** Convert n half precision values to float */
+inline void convert(const float16* src, float* dst, const size_t n) {
+	const uint16_t* in = (const uint16_t*)src;
+	size_t i = 0;
+#if defined(__AVX512F__)
+	for(;i+16<=n;i+=16)
+		_mm512_storeu_ps(dst+i, _mm512_maskz_cvtph_ps(AVX512_ALL, _mm256_loadu_si256((const __m256i*)(in+i))));
+#endif
+#if defined(__F16C__)
+	for(;i+8<=n;i+=8)
+		_mm256_storeu_ps(dst+i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in+i))));
+#endif
+	for(;i<n;i++)
+		dst[i] = float16::toFloat(in[i]);
+}
+
+/** Convert n floats to bfloat16 */
+inline void convert(const float* src, bfloat16* dst, const size_t n) {
+	uint16_t* out = (uint16_t*)dst;
+	size_t i = 0;
+	// Integer rounding instead of VCVTNEPS2BF16, which flushes denormals. This
+	// keeps the results bit-identical to the scalar conversion
+#if defined(__AVX512F__)
+	{
+		const __m512i one = _mm512_set1_epi32(1);
+		const __m512i bias = _mm512_set1_epi32(0x7FFF);
+		const __m512i abs_mask = _mm512_set1_epi32(0x7FFFFFFF);
+		const __m512i infty = _mm512_set1_epi32(0x7F800000);
+		const __m512i quiet = _mm512_set1_epi32(0x40);
+		for(;i+16<=n;i+=16) {
+			const __m512i x = _mm512_castps_si512(_mm512_loadu_ps(src+i));
+			const __m512i hi = _mm512_maskz_srli_epi32(AVX512_ALL, x, 16);
+			const __m512i lsb = _mm512_and_si512(hi, one);
+			__m512i r = _mm512_maskz_srli_epi32(AVX512_ALL, _mm512_add_epi32(x, _mm512_add_epi32(bias, lsb)), 16);
+			const __mmask16 nan = _mm512_cmpgt_epi32_mask(_mm512_and_si512(x, abs_mask), infty);
+			r = _mm512_mask_mov_epi32(r, nan, _mm512_or_si512(hi, quiet));
+			_mm256_storeu_si256((__m256i*)(out+i), _mm512_maskz_cvtepi32_epi16(AVX512_ALL, r));
+		}
+	}
+#endif
+#if defined(__AVX2__)
+	{
+		const __m256i one = _mm256_set1_epi32(1);
+		const __m256i bias = _mm256_set1_epi32(0x7FFF);
+		const __m256i abs_mask = _mm256_set1_epi32(0x7FFFFFFF);
+		const __m256i infty = _mm256_set1_epi32(0x7F800000);
+		const __m256i quiet = _mm256_set1_epi32(0x40);
+		for(;i+8<=n;i+=8) {
+			const __m256i x = _mm256_castps_si256(_mm256_loadu_ps(src+i));
+			const __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), one);
+			__m256i r = _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_add_epi32(bias, lsb)), 16);
+			const __m256i nan = _mm256_cmpgt_epi32(_mm256_and_si256(x, abs_mask), infty);
+			r = _mm256_blendv_epi8(r, _mm256_or_si256(_mm256_srli_epi32(x, 16), quiet), nan);
+			// Pack to 16 bit: packus works per 128-bit lane, so fix the lane order afterwards
+			r = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+			_mm_storeu_si128((__m128i*)(out+i), _mm256_castsi256_si128(r));
+		}
+	}
+#endif
+	for(;i<n;i++)
+		out[i] = bfloat16::fromFloat(src[i]);
+}
+
+/** Convert n bfloat16 values to float */
+inline void convert(const bfloat16* src, float* dst, const size_t n) {
+	const uint16_t* in = (const uint16_t*)src;
+	size_t i = 0;
+#if defined(__AVX512F__)
+	for(;i+16<=n;i+=16) {
+		const __m512i x = _mm512_maskz_cvtepu16_epi32(AVX512_ALL, _mm256_loadu_si256((const __m256i*)(in+i)));
+		_mm512_storeu_ps(dst+i, _mm512_castsi512_ps(_mm512_maskz_slli_epi32(AVX512_ALL, x, 16)));
+	}
+#endif
+#if defined(__AVX2__)
+	for(;i+8<=n;i+=8) {
+		const __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in+i)));
+		_mm256_storeu_ps(dst+i, _mm256_castsi256_ps(_mm256_slli_epi32(x, 16)));
+	}
+#endif
+	for(;i<n;i++)
+		dst[i] = bfloat16::toFloat(in[i]);
+}
+
+/**
+ * Convert between double and a reduced precision type by staging blocks in a
+ * float buffer on the stack. Narrowing rounds to float first.
+ */
+template <class H>
+inline void convert(const double* src, H* dst, const size_t n) {
+	const size_t block = 256;
+	float buf[block];
+	for(size_t i=0;i<n;i+=block) {
+		const size_t len = (n-i < block) ? n-i : block;
+		for(size_t j=0;j<len;j++) buf[j] = (float)src[i+j];
+		convert(buf, dst+i, len);
+	}
+}
+
+/** Convert reduced precision values to double via a float buffer on the stack */
+template <class H>
+inline void convert(const H* src, double* dst, const size_t n) {
+	const size_t block = 256;
+	float buf[block];
+	for(size_t i=0;i<n;i+=block) {
+		const size_t len = (n-i < block) ? n-i : block;
+		convert(src+i, buf, len);
+		for(size_t j=0;j<len;j++) dst[i+j] = (double)buf[j];
+	}
+}
+
+}
+
+#endif
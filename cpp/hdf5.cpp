@@ -10,6 +10,7 @@
 #include "hdf5.hpp"
 
 #include <cstring>
+#include <algorithm>
 
 #include <unistd.h>
 #include <hdf5.h>
@@ -44,16 +45,19 @@ void HDF5Exception::printStack(FILE* stream) {
 HDF5File::HDF5File(HDF5File &file) {
 	this->fid = 0;
 	this->_rootGroup = NULL;
+	this->_maxHandles = DEFAULT_MAX_HANDLES;
 	this->init(file._filename.c_str());
 }
 HDF5File::HDF5File(std::string filename, bool readOnly) {
 	this->fid = 0;
 	this->_rootGroup = NULL;
+	this->_maxHandles = DEFAULT_MAX_HANDLES;
 	this->init(filename.c_str(), readOnly);
 }
 HDF5File::HDF5File(const char* filename, bool readOnly) {
 	this->fid = 0;
 	this->_rootGroup = NULL;
+	this->_maxHandles = DEFAULT_MAX_HANDLES;
 	this->init(filename, readOnly);
 }
 
@@ -90,6 +94,10 @@ void HDF5File::close(void) {
 	}
 	this->_objects.clear();
 	this->_rootGroup = NULL;		// Already deleted within the object iterator
+	for(unordered_map<string, CachedHandle>::iterator it = this->_handles.begin(); it != this->_handles.end(); ++it)
+		H5Oclose(it->second.id);
+	this->_handles.clear();
+	this->_lru.clear();
 
 	// Ultimately, close file
 	if(this->fid > 0) H5Fclose(this->fid);
@@ -124,22 +132,93 @@ void HDF5File::addObject(HDF5Object *obj) {
 	else this->_objects.push_back(obj);
 }
 
-HDF5Group* HDF5File::group(std::string name) {
-	HDF5Group *group = new HDF5Group(this, name);
-	// Note: Objects are now added via the HDF5Object constructor
-	//this->_objects.append(group);
-	return group;
+hid_t HDF5File::openHandle(const std::string &pathname, const H5I_type_t idType) {
+	unordered_map<string, CachedHandle>::iterator it = this->_handles.find(pathname);
+	if(it != this->_handles.end() && H5Iget_type(it->second.id) == idType) {
+		if(H5Iinc_ref(it->second.id) < 0) throw HDF5Exception("Error referencing cached handle");
+		this->_lru.splice(this->_lru.begin(), this->_lru, it->second.lruPos);
+		return it->second.id;
+	}
+	hid_t id;
+	if(idType == H5I_GROUP) {
+		id = H5Gopen(this->fid, pathname.c_str(), H5P_DEFAULT);
+		if(id < 0) throw HDF5Exception("Error opening group");
+	} else {
+		id = H5Dopen(this->fid, pathname.c_str(), H5P_DEFAULT);
+		if(id < 0) throw HDF5Exception("Error opening dataset");
+	}
+	if(this->_maxHandles == 0) return id;
+	if(H5Iinc_ref(id) < 0) {
+		H5Oclose(id);
+		throw HDF5Exception("Error referencing cached handle");
+	}
+	if(it != this->_handles.end()) this->dropHandles(pathname);
+	this->_lru.push_front(pathname);
+	CachedHandle handle;
+	handle.id = id;
+	handle.lruPos = this->_lru.begin();
+	handle.hasInfo = false;
+	this->_handles[pathname] = handle;
+	this->evictHandles();
+	return id;
+}
+
+void HDF5File::evictHandles(void) {
+	while(this->_handles.size() > this->_maxHandles) {
+		unordered_map<string, CachedHandle>::iterator it = this->_handles.find(this->_lru.back());
+		H5Oclose(it->second.id);
+		this->_handles.erase(it);
+		this->_lru.pop_back();
+	}
 }
 
-HDF5Group* HDF5File::rootGroup() {
-	return this->_rootGroup;
+void HDF5File::dropHandles(const std::string &pathname) {
+	const string prefix = (pathname.length() > 0 && pathname.at(pathname.length()-1) == '/') ? pathname : pathname + "/";
+	unordered_map<string, CachedHandle>::iterator it = this->_handles.begin();
+	while(it != this->_handles.end()) {
+		if(it->first == pathname || it->first.compare(0, prefix.length(), prefix) == 0) {
+			H5Oclose(it->second.id);
+			this->_lru.erase(it->second.lruPos);
+			it = this->_handles.erase(it);
+		} else
+			++it;
+	}
+}
+
+const HDF5File::DatasetInfo* HDF5File::datasetInfo(const std::string &pathname) const {
+	unordered_map<string, CachedHandle>::const_iterator it = this->_handles.find(pathname);
+	if(it == this->_handles.end() || !it->second.hasInfo) return NULL;
+	return &it->second.info;
+}
+
+void HDF5File::setDatasetInfo(const std::string &pathname, const DatasetInfo &info) {
+	unordered_map<string, CachedHandle>::iterator it = this->_handles.find(pathname);
+	if(it == this->_handles.end() || H5Iget_type(it->second.id) != H5I_DATASET) return;
+	it->second.info = info;
+	it->second.hasInfo = true;
+}
+
+void HDF5File::setMaxHandles(const size_t maxHandles) {
+	this->_maxHandles = maxHandles;
+	this->evictHandles();
+}
+
+HDF5Group* HDF5File::group(std::string name) {
+	if(name.length() > 0 && name.at(0) != '/') name = "/" + name;
+	const hid_t id = this->openHandle(name, H5I_GROUP);
+	// Note: Objects are now added via the HDF5Object constructor
+	return new HDF5Group(this, name, id);
 }
 
 HDF5Dataset* HDF5File::dataset(std::string name) {
-	HDF5Dataset *ds = new HDF5Dataset(this, name);
+	if(name.length() > 0 && name.at(0) != '/') name = "/" + name;
+	const hid_t id = this->openHandle(name, H5I_DATASET);
 	// Note: Objects are now added via the HDF5Object constructor
-	// this->_objects.append(ds);
-	return ds;
+	return new HDF5Dataset(this, name, id);
+}
+
+HDF5Group* HDF5File::rootGroup() {
+	return this->_rootGroup;
 }
 
 HDF5Group* HDF5File::createGroup(std::string name) {
@@ -153,53 +232,163 @@ HDF5Group* HDF5File::createGroup(std::string name) {
 	return this->group(name);
 }
 
+const size_t HDF5File::DEFAULT_MAX_HANDLES;
+const size_t HDF5DatasetOptions::DEFAULT_CHUNK_BYTES;
+const size_t HDF5DatasetOptions::UNLIMITED;
+const size_t HDF5Dataset::SLAB_BYTES;
+const size_t HDF5Dataset::SLAB_RUN;
+const size_t HDF5Dataset::MEMSPACE_CACHE;
+
+std::vector<size_t> HDF5DatasetOptions::chunkShape(const int nDims, const size_t* dims, const size_t typeSize, const size_t targetBytes) {
+	std::vector<size_t> chunk(nDims);
+	size_t bytes = typeSize;
+	for(int i=0;i<nDims;i++) {
+		chunk[i] = (dims[i] > 0) ? dims[i] : 1;
+		bytes *= chunk[i];
+	}
+	while(bytes > targetBytes) {
+		int longest = 0;
+		for(int i=1;i<nDims;i++)
+			if(chunk[i] > chunk[longest]) longest = i;
+		if(chunk[longest] <= 1) break;
+		bytes /= chunk[longest];
+		chunk[longest] = (chunk[longest]+1)/2;
+		bytes *= chunk[longest];
+	}
+	return chunk;
+}
+
 HDF5Dataset* HDF5File::createDataset(std::string name, int nDims, size_t* dimSize, int flags) {
+	(void)flags;		// Not used at this moment
+	return this->createTypedDataset(name, nDims, dimSize, H5T_NATIVE_DOUBLE, HDF5DatasetOptions());
+}
+
+HDF5Dataset* HDF5File::createDataset(std::string name, int nDims, size_t* dimSize, const HDF5DatasetOptions &options) {
+	return this->createTypedDataset(name, nDims, dimSize, H5T_NATIVE_DOUBLE, options);
+}
+
+/** Maximum extent of dimension i for the given options, H5S_UNLIMITED for unlimited */
+static hsize_t dataset_max_dim(const HDF5DatasetOptions &options, const int i, const size_t* dims) {
+	if(i >= (int)options.maxDims.size() || options.maxDims[i] == 0) return dims[i];
+	if(options.maxDims[i] == HDF5DatasetOptions::UNLIMITED) return H5S_UNLIMITED;
+	if(options.maxDims[i] < dims[i]) throw HDF5Exception("Maximum dimension smaller than dimension");
+	return options.maxDims[i];
+}
+
+/** Build the dataset creation property list for the given options */
+static hid_t dataset_create_plist(const HDF5DatasetOptions &options, const int nDims, const size_t* dims, const hid_t dtype_id) {
+	hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+	if(dcpl < 0) throw HDF5Exception("Error creating dataset creation property list");
+	try {
+		if((int)options.maxDims.size() > nDims) throw HDF5Exception("Maximum dimensions rank exceeds the dataset rank");
+		if(options.isChunked()) {
+			// Chunks are bounded by the maximum instead of the current dimensions
+			size_t bounds[H5S_MAX_RANK];
+			size_t fixedBytes = H5Tget_size(dtype_id);
+			for(int i=0;i<nDims;i++) {
+				const hsize_t max = dataset_max_dim(options, i, dims);
+				bounds[i] = (max == H5S_UNLIMITED) ? 0 : (size_t)max;
+				if(bounds[i] > 0) fixedBytes *= bounds[i];
+			}
+			std::vector<size_t> chunk = options.chunk;
+			if(chunk.empty()) {
+				const size_t target = (options.chunkBytes > 0) ? options.chunkBytes : HDF5DatasetOptions::DEFAULT_CHUNK_BYTES;
+				// Unlimited dimensions take whatever is left of the target size
+				size_t shape[H5S_MAX_RANK];
+				for(int i=0;i<nDims;i++)
+					shape[i] = (bounds[i] > 0) ? bounds[i] : ((fixedBytes < target) ? target/fixedBytes : 1);
+				chunk = HDF5DatasetOptions::chunkShape(nDims, shape, H5Tget_size(dtype_id), target);
+			}
+			if((int)chunk.size() != nDims) throw HDF5Exception("Chunk rank does not match the dataset rank");
+			hsize_t cdims[H5S_MAX_RANK];
+			for(int i=0;i<nDims;i++) {
+				if(chunk[i] == 0 || (bounds[i] > 0 && chunk[i] > bounds[i])) throw HDF5Exception("Illegal chunk dimension");
+				cdims[i] = chunk[i];
+			}
+			if(H5Pset_chunk(dcpl, nDims, cdims) < 0) throw HDF5Exception("Error setting chunk dimensions");
+		}
+		if(options.hasFillValue) {
+			if(H5Pset_fill_value(dcpl, H5T_NATIVE_DOUBLE, &options.fillValue) < 0) throw HDF5Exception("Error setting fill value");
+		}
+		switch(options.fillTime) {
+			case HDF5DatasetOptions::FILL_NEVER:
+				if(H5Pset_fill_time(dcpl, H5D_FILL_TIME_NEVER) < 0) throw HDF5Exception("Error setting fill time");
+				break;
+			case HDF5DatasetOptions::FILL_ALLOC:
+				if(H5Pset_fill_time(dcpl, H5D_FILL_TIME_ALLOC) < 0) throw HDF5Exception("Error setting fill time");
+				break;
+			default:
+				break;
+		}
+		// Filter pipeline: shuffle, deflate, custom filters, checksum of the stored chunk
+		if(options.shuffle) {
+			if(H5Pset_shuffle(dcpl) < 0) throw HDF5Exception("Error setting shuffle filter");
+		}
+		if(options.deflate >= 0) {
+			if(options.deflate > 9) throw HDF5Exception("Illegal deflate level");
+			if(H5Zfilter_avail(H5Z_FILTER_DEFLATE) <= 0) throw HDF5Exception("Deflate filter not available");
+			if(H5Pset_deflate(dcpl, (unsigned int)options.deflate) < 0) throw HDF5Exception("Error setting deflate filter");
+		}
+		for(size_t i=0;i<options.filters.size();i++) {
+			const HDF5Filter &f = options.filters[i];
+			// HDF5 skips optional filters that are not registered, mandatory ones must be available
+			if((f.flags & H5Z_FLAG_OPTIONAL) == 0 && H5Zfilter_avail(f.id) <= 0) throw HDF5Exception("Filter not available");
+			if(H5Pset_filter(dcpl, f.id, f.flags, f.params.size(), f.params.empty() ? NULL : &f.params[0]) < 0)
+				throw HDF5Exception("Error setting filter");
+		}
+		if(options.fletcher32) {
+			if(H5Pset_fletcher32(dcpl) < 0) throw HDF5Exception("Error setting fletcher32 filter");
+		}
+	} catch (...) {
+		H5Pclose(dcpl);
+		throw;
+	}
+	return dcpl;
+}
+
+HDF5Dataset* HDF5File::createTypedDataset(std::string name, int nDims, size_t* dimSize, hid_t dtype_id, const HDF5DatasetOptions &options) {
 	if (name.length() == 0) throw HDF5Exception("Empty dataset name");
+	if (nDims <= 0 || nDims > H5S_MAX_RANK) throw HDF5Exception("Illegal dataset rank");
 
 	// Check for absolute path, and make it a child of root, if it is a name only
 	if(name.at(0) != '/') name = "/" + name;
-	(void)flags;		// Not used at this moment
 
 	// Identifiers
 	hid_t    dataset_id = 0;
 	hid_t    dataspace_id = 0;
-	hsize_t* dims = new hsize_t[nDims];
+	hid_t    dcpl_id = 0;
+	hsize_t  dims[H5S_MAX_RANK];
+	hsize_t  maxDims[H5S_MAX_RANK];
 	// herr_t   status;
 	try {
-		hid_t dtype_id = H5T_NATIVE_DOUBLE;
-		// XXX: Include flags for the following types:
-		// 		H5T_NATIVE_FLOAT
-		//		H5T_NATIVE_INT
-		//		H5T_NATIVE_LONG
-		// see https://www.hdfgroup.org/HDF5/Tutor/datatypes.html
-
+		dcpl_id = dataset_create_plist(options, nDims, dimSize, dtype_id);
 
 		/* Create the data space for the dataset. */
-		for(int i=0;i<nDims;i++)
+		for(int i=0;i<nDims;i++) {
 			dims[i] = dimSize[i];
-		dataspace_id = H5Screate_simple(nDims, dims, NULL);
+			maxDims[i] = dataset_max_dim(options, i, dimSize);
+		}
+		dataspace_id = H5Screate_simple(nDims, dims, maxDims);
 		if(dataspace_id < 0) throw HDF5Exception("Error creating dataspace");
 
 		/* Create the dataset. */
-		dataset_id = H5Dcreate2(this->fid, name.c_str(), dtype_id, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+		dataset_id = H5Dcreate2(this->fid, name.c_str(), dtype_id, dataspace_id, H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
 		if(dataset_id < 0) throw HDF5Exception("Error creating dataset");
 
 
 		// Cleanup
-		delete[] dims;
 		if(dataset_id > 0)   H5Dclose(dataset_id);
 		if(dataspace_id > 0) H5Sclose(dataspace_id);
+		if(dcpl_id > 0)      H5Pclose(dcpl_id);
 
 
 		// Open dataset
 		return this->dataset(name);
 	} catch (...) {
-		// Cleanup
-		delete[] dims;
-
 		// Close in reverse order
 		if(dataset_id > 0)   H5Dclose(dataset_id);
 		if(dataspace_id > 0) H5Sclose(dataspace_id);
+		if(dcpl_id > 0)      H5Pclose(dcpl_id);
 		throw;
 	}
 }
@@ -228,6 +417,11 @@ HDF5Object::~HDF5Object(void) {
 		this->_file->removeObject(this);
 }
 
+void HDF5Object::release(void) {
+	if(this->_file != NULL && this == this->_file->_rootGroup) return;
+	delete this;
+}
+
 bool HDF5Object::isClosed(void) {
 	return this->_id <= 0;
 }
@@ -352,6 +546,9 @@ void HDF5Object::linkDelete(const char* name) {
 	hid_t lapl_id = 0;
 	const herr_t status = H5Ldelete( this->_id, name, lapl_id );
 	if(status < 0) throw HDF5Exception("Error deleting link");
+	// A new object at the same pathname must not be served from the handle cache
+	if(this->_file != NULL)
+		this->_file->dropHandles((name[0] == '/') ? string(name) : this->groupPathname() + name);
 }
 
 int HDF5Object::type() { return this->_type; }
@@ -434,9 +631,9 @@ static void writeAttribute(hid_t id, const char* name, hid_t mem_type, void* val
 
 
 
-HDF5Group::HDF5Group(HDF5File *file, string name) : HDF5Object(file) {
+HDF5Group::HDF5Group(HDF5File *file, string name, hid_t id) : HDF5Object(file) {
 	this->_pathname = name;
-	this->_id = H5Gopen(this->fid(), name.c_str(), H5P_DEFAULT);
+	this->_id = (id > 0) ? id : H5Gopen(this->fid(), name.c_str(), H5P_DEFAULT);
 	if(this->_id < 0) throw HDF5Exception("Error opening group");
 	this->attrs = HDF5AttributeManager(this);
 
@@ -490,6 +687,11 @@ HDF5Dataset* HDF5Group::createDataset(std::string name, int nDims, size_t* dims,
 	return this->_file->createDataset(pathname, nDims, dims, flags);
 }
 
+HDF5Dataset* HDF5Group::createDataset(std::string name, int nDims, size_t* dims, const HDF5DatasetOptions &options) {
+	if(name.length() == 0) throw HDF5Exception("Empty dataset pathname");
+	return this->_file->createDataset(this->relativePath(name), nDims, dims, options);
+}
+
 
 
 
@@ -501,13 +703,17 @@ HDF5Dataset* HDF5Group::createDataset(std::string name, int nDims, size_t* dims,
 
 
 
-HDF5Dataset::HDF5Dataset(HDF5File *file, string pathname) : HDF5Object(file) {
+HDF5Dataset::HDF5Dataset(HDF5File *file, string pathname, hid_t id) : HDF5Object(file) {
 	if(pathname.length() == 0) throw HDF5Exception("Cannot open empty pathname");
 	this->_pathname = pathname;
 	this->d_dims = NULL;
+	this->d_chunkRows = 0;
+	this->d_pendingRows = 0;
+	this->d_pendingType = 0;
+	this->d_space = 0;
 	this->attrs = HDF5AttributeManager(this);
 
-	this->_id = H5Dopen(this->fid(), pathname.c_str(), H5P_DEFAULT);
+	this->_id = (id > 0) ? id : H5Dopen(this->fid(), pathname.c_str(), H5P_DEFAULT);
 	if(this->_id < 0) throw HDF5Exception("Error opening dataset");
 
 	// Open dataspace and get properties
@@ -517,22 +723,41 @@ HDF5Dataset::HDF5Dataset(HDF5File *file, string pathname) : HDF5Object(file) {
 	try {
 		herr_t status = 0;
 
-		this->d_datatype    = H5Dget_type(this->_id);
-		this->d_class       = H5Tget_class(d_datatype);
-		this->d_order       = H5Tget_order(d_datatype);
-		this->d_size        = H5Tget_size(d_datatype);
-
+		// Datatype, rank and maximum extent are known if the dataset was opened before
+		const HDF5File::DatasetInfo *cached = file->datasetInfo(pathname);
+		HDF5File::DatasetInfo info;
+		if(cached != NULL)
+			info = *cached;
+		else {
+			const hid_t datatype = H5Dget_type(this->_id);
+			if(datatype < 0) throw HDF5Exception("Error getting datatype from dataset");
+			info.typeClass  = H5Tget_class(datatype);
+			info.order      = H5Tget_order(datatype);
+			info.typeSize   = H5Tget_size(datatype);
+			H5Tclose(datatype);
+			info.rank       = H5Sget_simple_extent_ndims(dataspace);
+			if(info.rank < 0) throw HDF5Exception("Error getting dataset properties");
+		}
+		this->d_class       = info.typeClass;
+		this->d_order       = info.order;
+		this->d_size        = info.typeSize;
+		this->d_rank        = info.rank;
 
-		// Get rank and dimensions
-		this->d_rank        = H5Sget_simple_extent_ndims(dataspace);
+		// The dimensions change with appends and are always read
 		this->d_dims        = new hsize_t[d_rank];
-		status              = H5Sget_simple_extent_dims(dataspace, d_dims, NULL);
+		hsize_t maxDims[H5S_MAX_RANK];
+		status              = H5Sget_simple_extent_dims(dataspace, d_dims, maxDims);
 
 		if ((status < 0) || ( (int)status != (int)d_rank))
 			throw HDF5Exception("Error getting dataset properties");
+		if(cached == NULL) {
+			info.maxRows = (d_rank > 0) ? maxDims[0] : 0;
+			file->setDatasetInfo(pathname, info);
+		}
+		this->d_maxRows     = info.maxRows;
 
-
-		H5Sclose(dataspace);
+		// Keep the dataspace as cached file dataspace for the first transfer
+		this->d_space = dataspace;
 	} catch(...) {
 		// Emergency close
 		H5Sclose(dataspace);
@@ -543,7 +768,13 @@ HDF5Dataset::HDF5Dataset(HDF5File *file, string pathname) : HDF5Object(file) {
 }
 
 HDF5Dataset::~HDF5Dataset() {
-	this->close();
+	try {
+		this->close();
+	} catch (...) {
+		// Destructors must not throw. Pending rows are lost
+		if(this->_id > 0) H5Dclose(this->_id);
+		this->_id = 0;
+	}
 
 	if(this->d_dims != NULL)
 		delete[] this->d_dims;
@@ -557,15 +788,67 @@ long HDF5Dataset::getStorageSize(void) {
 }
 
 void HDF5Dataset::close(void) {
-	if(this->_id > 0) H5Dclose(this->_id);
+	if(this->_id > 0) {
+		try {
+			this->flush();
+		} catch (...) {
+			this->closeSpaces();
+			this->closeMemSpaces();
+			H5Dclose(this->_id);
+			this->_id = 0;
+			throw;
+		}
+		this->closeSpaces();
+		this->closeMemSpaces();
+		H5Dclose(this->_id);
+	}
 	this->_id = 0;
 }
 
+hid_t HDF5Dataset::fileSpace(void) {
+	if(this->d_space <= 0) {
+		this->d_space = H5Dget_space(this->_id);
+		if(this->d_space < 0) {
+			this->d_space = 0;
+			throw HDF5Exception("Error getting dataspace");
+		}
+	}
+	return this->d_space;
+}
+
+void HDF5Dataset::closeSpaces(void) {
+	if(this->d_space > 0) H5Sclose(this->d_space);
+	this->d_space = 0;
+}
+
+void HDF5Dataset::closeMemSpaces(void) {
+	for(size_t i=0;i<this->d_memSpaces.size();i++) H5Sclose(this->d_memSpaces[i].id);
+	this->d_memSpaces.clear();
+}
+
 string HDF5Dataset::name(void) {
 	return extractFilename(this->pathname());
 }
 
 
+std::vector<size_t> HDF5Dataset::chunk(void) {
+	std::vector<size_t> result;
+	if(this->isClosed()) throw HDF5Exception("Dataset closed");
+	const hid_t dcpl = H5Dget_create_plist(this->_id);
+	if(dcpl < 0) throw HDF5Exception("Error getting dataset creation property list");
+	if(H5Pget_layout(dcpl) == H5D_CHUNKED) {
+		hsize_t cdims[H5S_MAX_RANK];
+		const int rank = H5Pget_chunk(dcpl, H5S_MAX_RANK, cdims);
+		for(int i=0;i<rank;i++) result.push_back((size_t)cdims[i]);
+	}
+	H5Pclose(dcpl);
+	return result;
+}
+
+bool HDF5Dataset::isExtendable(void) {
+	return this->d_rank > 0 && this->d_maxRows > this->d_dims[0];
+}
+
 bool HDF5Dataset::isInteger() {
 	return d_class == H5T_INTEGER;
 }
@@ -602,173 +885,215 @@ size_t HDF5Dataset::dims(int dim) {
 }
 
 
-static size_t hdf5_read(hid_t dataset, double *dst, const size_t dims, const size_t* n, const size_t* offset_ = NULL) {
-	herr_t      status = 0;
-	hid_t       memspace = 0;
-	hid_t       dataspace = 0;
-
-	/* Hyperslab in the file */
-	hsize_t* count = new hsize_t[dims];
-	/* Hyperslab offset in the file */
-	hsize_t* offset = new hsize_t[dims];
-	/* Hyperslab offset in memory */
-	hsize_t* offset_out = new hsize_t[dims];
-	/* Memory space dimensions */
-	hsize_t* dimsm = new hsize_t[dims];
-
-	for(size_t i = 0;i<dims;i++) {
-		count[i] = n[i];
-		if(offset_ == NULL)
-			offset[i] = 0;
-		else
-			offset[i] = offset_[i];
-		offset_out[i] = 0;
-	}
-
-	ssize_t result = -1;
-	try {
-		dataspace = H5Dget_space(dataset);
-		if(dataspace < 0) throw HDF5Exception("Error getting dataspace");
-
-		if(offset_ != NULL) {
-			status = H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, offset, NULL, count, NULL);
-			if(status < 0) throw HDF5Exception("Error selecting hyperslab");
-		}
-
-		// Define memory space
-		const hsize_t n_dims = hsize_t(dims);
-		for(size_t i = 0;i<dims;i++) {
-			dimsm[i] = count[i];
-			result *= count[i];
+hid_t HDF5Dataset::memSpace(const int rank, const hsize_t* dims) {
+	for(size_t i=0;i<this->d_memSpaces.size();i++) {
+		const MemSpace &m = this->d_memSpaces[i];
+		if(m.rank == rank && memcmp(m.dims, dims, rank*sizeof(hsize_t)) == 0) {
+			// Move to the front
+			std::rotate(this->d_memSpaces.begin(), this->d_memSpaces.begin()+i, this->d_memSpaces.begin()+i+1);
+			return this->d_memSpaces[0].id;
 		}
-		memspace = H5Screate_simple(n_dims, dimsm, NULL);
-		if(memspace < 0) throw HDF5Exception("Error creating memspace");
-
-		if(offset_ != NULL) {
-			status = H5Sselect_hyperslab(memspace, H5S_SELECT_SET, offset_out, NULL, count, NULL);
-			if(status < 0) throw HDF5Exception("Error selecting memory space hyperslab");
-		}
-
-		// Read from file
-		status = H5Dread(dataset, H5T_NATIVE_DOUBLE, memspace, dataspace, H5P_DEFAULT, dst);
-		if(status < 0) throw HDF5Exception("Error reading from HDF5 file");
-
-		// Everything went fine
-		result = -result;
-	} catch (...) {
-		delete[] count;
-		delete[] offset;
-		delete[] offset_out;
-		delete[] dimsm;
-		// Cleanup
-		if(dataspace > 0) H5Sclose(dataspace);
-		if(memspace > 0)  H5Sclose(memspace);
-		throw;
 	}
+	MemSpace m;
+	m.rank = rank;
+	memcpy(m.dims, dims, rank*sizeof(hsize_t));
+	m.id = H5Screate_simple(rank, dims, NULL);
+	if(m.id < 0) throw HDF5Exception("Error creating memspace");
+	if(this->d_memSpaces.size() >= MEMSPACE_CACHE) {
+		H5Sclose(this->d_memSpaces.back().id);
+		this->d_memSpaces.pop_back();
+	}
+	this->d_memSpaces.insert(this->d_memSpaces.begin(), m);
+	return m.id;
+}
 
-	// Close and cleanup
-	delete[] count;
-	delete[] offset;
-	delete[] offset_out;
-	delete[] dimsm;
-	H5Sclose(dataspace);
-	H5Sclose(memspace);
-
+size_t HDF5Dataset::transfer(const bool write, hid_t memtype, void *buf, const size_t n, const size_t* count, const size_t* offset, const size_t* stride, const size_t* block) {
+	if(n > H5S_MAX_RANK) throw HDF5Exception("Illegal rank");
+	// Hyperslab in the file and memory space dimensions. Selected blocks are packed densely
+	hsize_t start[H5S_MAX_RANK], cnt[H5S_MAX_RANK], str[H5S_MAX_RANK], blk[H5S_MAX_RANK], dimsm[H5S_MAX_RANK];
+	size_t result = 1;
+	for(size_t i=0;i<n;i++) {
+		start[i] = (offset == NULL) ? 0 : offset[i];
+		cnt[i] = count[i];
+		str[i] = (stride == NULL) ? 1 : stride[i];
+		blk[i] = (block == NULL) ? 1 : block[i];
+		dimsm[i] = cnt[i]*blk[i];
+		result *= dimsm[i];
+	}
 
-	return (size_t)result;
+	const hid_t space = this->fileSpace();
+	herr_t status;
+	if(offset != NULL)
+		status = H5Sselect_hyperslab(space, H5S_SELECT_SET, start, str, cnt, blk);
+	else
+		status = H5Sselect_all(space);
+	if(status < 0) throw HDF5Exception("Error selecting hyperslab");
+	const hid_t memspace = this->memSpace((int)n, dimsm);
+
+	if(write)
+		status = H5Dwrite(this->_id, memtype, memspace, space, H5P_DEFAULT, buf);
+	else
+		status = H5Dread(this->_id, memtype, memspace, space, H5P_DEFAULT, buf);
+	if(status < 0) throw HDF5Exception(write ? "Error writing to HDF5 file" : "Error reading from HDF5 file");
+	return result;
 }
 
 
-// Write array dst to the given dataset hid_t
-// Memory -> File
-static size_t hdf5_write(hid_t dataset, double *dst, const size_t dims, const size_t* n, const size_t* offset_ = NULL) {
-	herr_t      status = 0;
-	hid_t       memspace = 0;
-	hid_t       dataspace = 0;
-
-	/* Hyperslab in the file */
-	hsize_t* count = new hsize_t[dims];
-	/* Hyperslab offset in the file */
-	hsize_t* offset = new hsize_t[dims];
-	/* Hyperslab offset in memory */
-	hsize_t* offset_out = new hsize_t[dims];
-	/* Memory space dimensions */
-	hsize_t* dimsm = new hsize_t[dims];
+size_t HDF5Dataset::rowCells(void) {
+	size_t result = 1;
+	for(int i=1;i<d_rank;i++)
+		result *= (size_t)(this->d_dims[i]);
+	return result;
+}
 
-	for(size_t i = 0;i<dims;i++) {
-		count[i] = n[i];
-		if(offset_ == NULL)
-			offset[i] = 0;
-		else
-			offset[i] = offset_[i];
-		offset_out[i] = 0;
+void HDF5Dataset::extendRows(const hsize_t rows) {
+	if(rows > this->d_maxRows) throw HDF5Exception("Dataset cannot grow beyond its maximum dimension");
+	// The extent always matches the rows in the file, so other instances never see unwritten rows.
+	// Rows are written in whole chunks, which keeps the number of extent changes small
+	hsize_t dims[H5S_MAX_RANK];
+	for(int i=0;i<d_rank;i++) dims[i] = this->d_dims[i];
+	dims[0] = rows;
+	if(H5Dset_extent(this->_id, dims) < 0) throw HDF5Exception("Error extending dataset");
+	this->closeSpaces();
+}
+
+void HDF5Dataset::appendRaw(hid_t memtype, const void *buf, const size_t count) {
+	if(this->d_rank == 0) throw HDF5Exception("Dataset is not extendable");
+	if(this->d_chunkRows == 0) {
+		// Only chunked datasets can change their extent
+		const std::vector<size_t> chunk = this->chunk();
+		if(chunk.empty()) throw HDF5Exception("Dataset is not extendable");
+		this->d_chunkRows = chunk[0];
+	}
+	if(this->d_dims[0] + count > this->d_maxRows) throw HDF5Exception("Dataset cannot grow beyond its maximum dimension");
+	if(this->d_pendingRows > 0 && !H5Tequal(memtype, this->d_pendingType)) this->writePending();
+
+	const size_t cells = this->rowCells();
+	const size_t rowBytes = cells * H5Tget_size(memtype);
+	size_t offset[H5S_MAX_RANK];
+	size_t n[H5S_MAX_RANK];
+	for(int i=1;i<d_rank;i++) {
+		offset[i] = 0;
+		n[i] = (size_t)this->d_dims[i];
 	}
 
-	ssize_t result = -1;
-	try {
-		dataspace = H5Dget_space(dataset);
-		if(dataspace < 0) throw HDF5Exception("Error getting dataspace");
-
-		if(offset_ != NULL) {
-			status = H5Sselect_hyperslab(dataspace, H5S_SELECT_SET, offset, NULL, count, NULL);
-			if(status < 0) throw HDF5Exception("Error selecting hyperslab");
-		}
-
-		// Define memory space
-		const hsize_t n_dims = hsize_t(dims);
-		for(size_t i = 0;i<dims;i++) {
-			dimsm[i] = count[i];
-			result *= count[i];
-		}
-		memspace = H5Screate_simple(n_dims, dimsm, dimsm);
-		if(memspace < 0) throw HDF5Exception("Error creating memspace");
-		if(offset_ != NULL) {
-			status = H5Sselect_hyperslab(memspace, H5S_SELECT_SET, offset_out, NULL, count, NULL);
-			if(status < 0) throw HDF5Exception("Error selecting memory space hyperslab");
+	const char *src = (const char*)buf;
+	size_t remaining = count;
+	while(remaining > 0) {
+		const hsize_t end = this->d_dims[0];
+		size_t rows;
+		if(this->d_pendingRows == 0 && end % this->d_chunkRows == 0 && remaining >= this->d_chunkRows) {
+			// Whole chunks are written directly from the source buffer
+			rows = remaining - remaining % this->d_chunkRows;
+			this->extendRows(end + rows);
+			offset[0] = (size_t)end;
+			n[0] = rows;
+			this->transfer(true, memtype, const_cast<char*>(src), this->d_rank, n, offset);
+			this->d_dims[0] += rows;
+		} else {
+			// Stage rows up to the next chunk boundary
+			const size_t toBoundary = (size_t)(this->d_chunkRows - end % this->d_chunkRows);
+			rows = (remaining < toBoundary) ? remaining : toBoundary;
+			this->d_pending.insert(this->d_pending.end(), src, src + rows*rowBytes);
+			this->d_pendingRows += rows;
+			this->d_pendingType = memtype;
+			this->d_dims[0] += rows;
+			if(rows == toBoundary) this->writePending();
 		}
-
-		// Write to file
-		status = H5Dwrite(dataset, H5T_NATIVE_DOUBLE, memspace, dataspace, H5P_DEFAULT, dst);
-		if(status < 0) throw HDF5Exception("Error reading from HDF5 file");
-
-		// Everything went fine
-		result = -result;
-	} catch (...) {
-		delete[] count;
-		delete[] offset;
-		delete[] offset_out;
-		delete[] dimsm;
-		// Cleanup
-		if(dataspace > 0) H5Sclose(dataspace);
-		if(memspace > 0)  H5Sclose(memspace);
-		throw;
+		src += rows*rowBytes;
+		remaining -= rows;
 	}
-
-	// Close and cleanup
-	delete[] count;
-	delete[] offset;
-	delete[] offset_out;
-	delete[] dimsm;
-	H5Sclose(dataspace);
-	H5Sclose(memspace);
-
-
-	return (size_t)result;
 }
 
+void HDF5Dataset::writePending(void) {
+	if(this->d_pendingRows == 0) return;
+	const hsize_t first = this->d_dims[0] - this->d_pendingRows;
+	this->extendRows(this->d_dims[0]);
+	size_t offset[H5S_MAX_RANK];
+	size_t n[H5S_MAX_RANK];
+	for(int i=0;i<d_rank;i++) {
+		offset[i] = 0;
+		n[i] = (size_t)this->d_dims[i];
+	}
+	offset[0] = (size_t)first;
+	n[0] = (size_t)this->d_pendingRows;
+	this->transfer(true, this->d_pendingType, &this->d_pending[0], this->d_rank, n, offset);
+	this->d_pending.clear();
+	this->d_pendingRows = 0;
+}
 
+void HDF5Dataset::flush(void) {
+	if(this->isClosed()) return;
+	this->writePending();
+}
 
 double HDF5Dataset::read_2d(size_t x, size_t y) {
 	if(this->isClosed()) throw HDF5Exception("Dataset closed");
 
+	if(this->d_rank != 2) throw HDF5Exception("Cannot read 2d point from not-2d dataset");
 	double buf;
-	size_t n[2] = {1,1};
 	// Remember: x,y are swapped
-	size_t offset[2] = {y,x};
-	hdf5_read(this->_id, &buf, 2, n, offset);
+	const size_t coord[2] = {y,x};
+	this->readPointsRaw(H5T_NATIVE_DOUBLE, &buf, coord, 1);
 	return buf;
 }
 
+size_t HDF5Dataset::readPointsRaw(hid_t memtype, void *buf, const size_t* coords, const size_t count) {
+	if(count == 0) return 0;
+	this->writePending();
+	const size_t rank = (size_t)this->d_rank;
+	// Single points use stack storage and the cached memory space
+	hsize_t point[H5S_MAX_RANK];
+	std::vector<hsize_t> points;
+	hsize_t *c = point;
+	// Linear index of every point in the file
+	std::vector<hsize_t> linear;
+	bool sorted = true;
+	if(count > 1) {
+		points.resize(count*rank);
+		linear.resize(count);
+		c = &points[0];
+	}
+	for(size_t i=0;i<count;i++) {
+		hsize_t index = 0;
+		for(size_t d=0;d<rank;d++) {
+			const size_t v = coords[i*rank+d];
+			if(v >= this->d_dims[d]) throw HDF5Exception("Point outside of the dataset");
+			c[i*rank+d] = v;
+			index = index*this->d_dims[d] + v;
+		}
+		if(count > 1) {
+			linear[i] = index;
+			if(i > 0 && index < linear[i-1]) sorted = false;
+		}
+	}
+	// Points in file order are read in one sweep instead of seeking back and forth.
+	// Values are then read into a temporary buffer and scattered to the requested order
+	std::vector<size_t> order;
+	std::vector<char> sortedBuf;
+	void *dst = buf;
+	if(!sorted) {
+		order.resize(count);
+		for(size_t i=0;i<count;i++) order[i] = i;
+		std::sort(order.begin(), order.end(), [&linear](const size_t a, const size_t b) { return linear[a] < linear[b]; });
+		for(size_t i=0;i<count;i++)
+			for(size_t d=0;d<rank;d++) c[i*rank+d] = coords[order[i]*rank+d];
+		sortedBuf.resize(count*H5Tget_size(memtype));
+		dst = &sortedBuf[0];
+	}
+
+	const hid_t space = this->fileSpace();
+	if(H5Sselect_elements(space, H5S_SELECT_SET, count, c) < 0) throw HDF5Exception("Error selecting points");
+	const hsize_t n = count;
+	const hid_t memspace = this->memSpace(1, &n);
+	if(H5Dread(this->_id, memtype, memspace, space, H5P_DEFAULT, dst) < 0) throw HDF5Exception("Error reading from HDF5 file");
+	if(!sorted) {
+		const size_t size = H5Tget_size(memtype);
+		for(size_t i=0;i<count;i++) memcpy((char*)buf + order[i]*size, &sortedBuf[i*size], size);
+	}
+	return count;
+}
+
 double HDF5Dataset::operator()(size_t x, size_t y) {
 	return this->read_2d(x,y);
 }
@@ -776,12 +1101,50 @@ double HDF5Dataset::operator()(size_t x, size_t y) {
 size_t HDF5Dataset::read_1d(double* buf, const size_t n) {
 	if(this->isClosed()) throw HDF5Exception("Dataset closed");
 	size_t dims[] = { n };
-	return hdf5_read(this->_id, buf, 1, dims);
+	return this->readRaw(H5T_NATIVE_DOUBLE, buf, 1, dims);
 }
 
 size_t HDF5Dataset::read(double *buf, const size_t n, const size_t* dims) {
 	if(this->isClosed()) throw HDF5Exception("Dataset closed");
-	return hdf5_read(this->_id, buf, n, dims);
+	return this->readRaw(H5T_NATIVE_DOUBLE, buf, n, dims);
+}
+
+size_t HDF5Dataset::readRaw(hid_t memtype, void *buf, const size_t n, const size_t* dims, const size_t* offset, const size_t* stride, const size_t* block) {
+	this->writePending();
+	return this->transfer(false, memtype, buf, n, dims, offset, stride, block);
+}
+
+size_t HDF5Dataset::writeRaw(hid_t memtype, const void *buf, const size_t n, const size_t* dims, const size_t* offset, const size_t* stride, const size_t* block) {
+	this->writePending();
+	return this->transfer(true, memtype, const_cast<void*>(buf), n, dims, offset, stride, block);
+}
+
+void HDF5Dataset::checkShape(const int rank, const size_t* dims) {
+	if(rank != this->d_rank) throw HDF5Exception("Rank does not match the dataset rank");
+	for(int i=0;i<rank;i++)
+		if(dims[i] != this->d_dims[i]) throw HDF5Exception("Dimensions do not match the dataset dimensions");
+}
+
+void HDF5Dataset::checkRegion(const size_t n, const size_t* offset, const size_t* count, const size_t* stride, const size_t* block) {
+	if(this->isClosed()) throw HDF5Exception("Dataset closed");
+	if((int)n != this->d_rank) throw HDF5Exception("Region rank does not match the dataset rank");
+	if(offset == NULL || count == NULL) throw HDF5Exception("Region offset and count required");
+	for(size_t i=0;i<n;i++) {
+		const size_t s = (stride == NULL) ? 1 : stride[i];
+		const size_t b = (block == NULL) ? 1 : block[i];
+		if(count[i] == 0 || b == 0) throw HDF5Exception("Empty region");
+		if(s < b) throw HDF5Exception("Region stride smaller than block");
+		if(offset[i] + (count[i]-1)*s + b > this->d_dims[i]) throw HDF5Exception("Region exceeds the dataset");
+	}
+}
+
+void HDF5Dataset::cubeRegion(const size_t nx, const size_t ny, const size_t nz, const size_t* block, size_t* count) {
+	const size_t size[3] = {nx, ny, nz};
+	for(int i=0;i<3;i++) {
+		const size_t b = (block == NULL) ? 1 : block[i];
+		if(b == 0 || size[i] % b != 0) throw HDF5Exception("Cube size is not a multiple of the block size");
+		count[i] = size[i] / b;
+	}
 }
 
 size_t HDF5Dataset::read(double** array) {
@@ -801,7 +1164,7 @@ size_t HDF5Dataset::read(double*& array) {
 size_t HDF5Dataset::write(double* array, size_t n) {
 	if(this->isClosed()) throw HDF5Exception("Dataset closed");
 	size_t dims[] = { n };
-	return hdf5_write(this->_id, array, 1, dims);
+	return this->writeRaw(H5T_NATIVE_DOUBLE, array, 1, dims);
 }
 
 #ifdef _FLEXLIB_ARRAY_HPP
@@ -898,70 +1261,19 @@ double HDF5Attribute::readDouble(void) {
 
 
 Cube<double> HDF5Dataset::readCube() {
-	if(this->isClosed()) throw HDF5Exception("Dataset closed");
-	if(this->d_rank != 3) throw HDF5Exception("Cannot read cube from not-2d dataset");
-	size_t dims[3] = {this->d_dims[0], this->d_dims[1], this->d_dims[2]};
-	const size_t size = dims[0] * dims[1] * dims[2];
-	Cube<double> result(dims[0], dims[1], dims[2]);
-
-	double *buf = new double[size];
-	this->read(buf, 3, dims);
-
-	size_t i=0;
-	for(size_t ix=0; ix < dims[0]; ix++) {
-		for(size_t iy=0; iy < dims[1]; iy++) {
-			for(size_t iz=0; iz < dims[2]; iz++) {
-				const double value = buf[i++];
-				result(ix,iy,iz) = value;
-			}
-		}
-	}
-	delete[] buf;
-
-	return result;
+	return this->readCube<double>();
 }
 
 void HDF5Dataset::writeCube(const Cube<double> &cube) {
-	if(this->isClosed()) throw HDF5Exception("Dataset closed");
-	size_t dims[3] = { cube.size(0), cube.size(1), cube.size(2) };
-	const size_t size = cube.size();
-
-	// Build buffer
-	double *buf = new double[size];
-	size_t i=0;
-
-	for(size_t ix=0; ix < dims[0]; ix++) {
-		for(size_t iy=0; iy < dims[1]; iy++) {
-			for(size_t iz=0; iz < dims[2]; iz++) {
-				buf[i++] = cube(ix,iy,iz);
-			}
-		}
-	}
-
-	// Write to actual HDF5
-	try {
-		hdf5_write(this->_id, buf, 3, dims);
-	} catch (...) {
-		delete[] buf;
-		throw;
-	}
-	delete[] buf;
+	this->writeCube<double>(cube);
 }
 
 void HDF5Dataset::writeArray(valarray<double> &array) {
-	// Must copy to local buffer
+	if(this->isClosed()) throw HDF5Exception("Dataset closed");
+	// valarray storage is contiguous
 	const size_t size = array.size();
-	double* buf = new double[size];
-	for(size_t i=0;i<size;i++) buf[i] = array[i];
-
 	size_t dims[1] = {size};
-	try {
-		hdf5_write(this->_id, buf, 1, dims);
-	} catch (...) {
-		delete[] buf;
-		throw;
-	}
-	delete[] buf;
+	if(size > 0) this->writeRaw(H5T_NATIVE_DOUBLE, &array[0], 1, dims);
 }
 
 
@@ -1,8 +1,8 @@
 /* =============================================================================
  *
  * Title:       Easy access to HDF5 files
- *                At this stage of the development the library supports only
- *                read access to HDF5
+ *                Read and write access to datasets of double, float, int32_t,
+ *                int64_t and uint8_t, groups and attributes
  * Author:      Felix Niederwanger
  * License:     MIT (http://opensource.org/licenses/MIT)
  * Description: Library, header file
@@ -35,8 +35,12 @@
 #include <vector>
 #include <exception>
 #include <map>
+#include <unordered_map>
+#include <list>
 #include <valarray>
+#include <algorithm>
 
+#include <stdint.h>
 #include <hdf5.h>
 #include "numeric.hpp"
 
@@ -53,6 +57,15 @@ class HDF5Attribute;
 class HDF5AttributeManager;
 
 
+/** Native HDF5 memory type of the supported element types */
+template <class T> struct NativeType;
+template <> struct NativeType<double>  { static hid_t type() { return H5T_NATIVE_DOUBLE; } };
+template <> struct NativeType<float>   { static hid_t type() { return H5T_NATIVE_FLOAT; } };
+template <> struct NativeType<int32_t> { static hid_t type() { return H5T_NATIVE_INT32; } };
+template <> struct NativeType<int64_t> { static hid_t type() { return H5T_NATIVE_INT64; } };
+template <> struct NativeType<uint8_t> { static hid_t type() { return H5T_NATIVE_UINT8; } };
+
+
 
 /** General HDF5 exception  */
 #if _FLEXLIB_HDF5_STANDALONE != 1
@@ -84,6 +97,124 @@ public:
 
 
 
+/** Filter of the HDF5 filter pipeline with its client data parameters */
+struct HDF5Filter {
+	/** Filter identifier, e.g. H5Z_FILTER_DEFLATE */
+	H5Z_filter_t id;
+	/** H5Z_FLAG_MANDATORY or H5Z_FLAG_OPTIONAL */
+	unsigned int flags;
+	std::vector<unsigned int> params;
+};
+
+/**
+ * Creation properties of a dataset. The default creates a contiguous dataset with
+ * default fill behaviour, like createDataset without options
+ */
+class HDF5DatasetOptions {
+public:
+	/** When the fill value is written to unwritten cells */
+	enum FillTime {
+		/** Fill only if a fill value is set (HDF5 default) */
+		FILL_DEFAULT = 0,
+		/** Never fill. Saves writing the whole dataset when it is overwritten anyway */
+		FILL_NEVER = 1,
+		/** Fill when the storage is allocated */
+		FILL_ALLOC = 2
+	};
+
+	/** Explicit chunk dimensions, one per dimension. Empty for automatic or contiguous layout */
+	std::vector<size_t> chunk;
+	/**
+	 * Target chunk size in bytes for the automatic chunk shape, used if chunk is empty.
+	 * 0 keeps the contiguous layout, unless filters require chunking
+	 */
+	size_t chunkBytes;
+	FillTime fillTime;
+	/** Whether fillValue is set as fill value of the dataset */
+	bool hasFillValue;
+	/** Fill value, converted to the dataset type */
+	double fillValue;
+	/** Byte shuffle before compression, which groups bytes of equal significance */
+	bool shuffle;
+	/** Deflate (zlib) compression level 0-9, or -1 for no compression */
+	int deflate;
+	/** Fletcher32 checksum of every chunk, verified on read */
+	bool fletcher32;
+	/**
+	 * Additional filters, applied in order after shuffle and deflate and before fletcher32.
+	 * Filters require a chunked layout
+	 */
+	std::vector<HDF5Filter> filters;
+	/**
+	 * Maximum dimensions, UNLIMITED for an unlimited and 0 for a fixed dimension. Missing
+	 * trailing entries are fixed, an empty vector creates a fixed-size dataset.
+	 * Extendable datasets require a chunked layout
+	 */
+	std::vector<size_t> maxDims;
+
+	/** Default chunk size in bytes if chunking is required but not configured */
+	static const size_t DEFAULT_CHUNK_BYTES = 1024*1024;
+	/** Maximum dimension of an unlimited dimension */
+	static const size_t UNLIMITED = (size_t)-1;
+
+	HDF5DatasetOptions() : chunkBytes(0), fillTime(FILL_DEFAULT), hasFillValue(false), fillValue(0), shuffle(false), deflate(-1), fletcher32(false) {}
+
+	/** Use a chunked layout with the given chunk dimensions */
+	HDF5DatasetOptions& chunked(const std::vector<size_t> &chunk) { this->chunk = chunk; return *this; }
+	/** Use a chunked layout with an automatic chunk shape of about the given size in bytes */
+	HDF5DatasetOptions& chunked(const size_t bytes = DEFAULT_CHUNK_BYTES) { this->chunkBytes = bytes; return *this; }
+	/** Set the fill value */
+	HDF5DatasetOptions& fill(const double value, const FillTime time = FILL_ALLOC) {
+		this->hasFillValue = true;
+		this->fillValue = value;
+		this->fillTime = time;
+		return *this;
+	}
+	/** Compress with deflate at the given level, with byte shuffle by default */
+	HDF5DatasetOptions& compressed(const int level = 4, const bool shuffle = true) {
+		this->deflate = level;
+		this->shuffle = shuffle;
+		return *this;
+	}
+	/** Make the given dimension unlimited, by default the leading one used by HDF5Dataset::append */
+	HDF5DatasetOptions& unlimited(const int dim = 0) {
+		if((int)this->maxDims.size() <= dim) this->maxDims.resize(dim+1, 0);
+		this->maxDims[dim] = UNLIMITED;
+		return *this;
+	}
+	/** Add a fletcher32 checksum to every chunk */
+	HDF5DatasetOptions& checksum(const bool enabled = true) { this->fletcher32 = enabled; return *this; }
+	/** Append a filter to the filter pipeline */
+	HDF5DatasetOptions& filter(const H5Z_filter_t id, const std::vector<unsigned int> &params = std::vector<unsigned int>(), const unsigned int flags = H5Z_FLAG_MANDATORY) {
+		HDF5Filter f;
+		f.id = id;
+		f.flags = flags;
+		f.params = params;
+		this->filters.push_back(f);
+		return *this;
+	}
+
+	/** True if the dataset will be chunked */
+	bool isChunked() const { return !this->chunk.empty() || this->chunkBytes > 0 || this->hasFilters() || this->isExtendable(); }
+	/** True if any filter is enabled */
+	bool hasFilters() const { return this->shuffle || this->deflate >= 0 || this->fletcher32 || !this->filters.empty(); }
+	/** True if any dimension can grow */
+	bool isExtendable() const {
+		for(size_t i=0;i<this->maxDims.size();i++)
+			if(this->maxDims[i] > 0) return true;
+		return false;
+	}
+
+	/**
+	 * Chunk shape of about targetBytes for a dataset with the given dimensions and element size.
+	 * Starting from the whole dataset, the longest chunk dimension is halved until the chunk
+	 * fits; on ties the slowest-varying dimension is halved first, which keeps the contiguous
+	 * extent of the fastest-varying dimension long
+	 */
+	static std::vector<size_t> chunkShape(const int nDims, const size_t* dims, const size_t typeSize, const size_t targetBytes = DEFAULT_CHUNK_BYTES);
+};
+
+
 /** Access to a HDF5 file */
 class HDF5File
 {
@@ -99,9 +230,53 @@ private:
     /** Main group */
     HDF5Group *_rootGroup;
 
+    /** Properties of a dataset that cannot change while it exists: datatype, rank and maximum extent */
+    struct DatasetInfo {
+    	H5T_class_t typeClass;
+    	H5T_order_t order;
+    	size_t typeSize;
+    	int rank;
+    	hsize_t maxRows;
+    };
+
+    /** Cached group or dataset identifier */
+    struct CachedHandle {
+    	/** Identifier, holding one reference of its own */
+    	hid_t id;
+    	/** Position in the LRU list */
+    	std::list<std::string>::iterator lruPos;
+    	/** Whether info is set, which is the case for datasets once an instance was created */
+    	bool hasInfo;
+    	DatasetInfo info;
+    };
+    /** Cached group and dataset identifiers by absolute pathname */
+    std::unordered_map<std::string, CachedHandle> _handles;
+    /** Pathnames of the cached identifiers, most recently used first */
+    std::list<std::string> _lru;
+    /** Maximum number of cached handles */
+    size_t _maxHandles;
+
+    /**
+     * Identifier of the group or dataset (idType H5I_GROUP or H5I_DATASET) at the given absolute
+     * pathname, opened on a cache miss. Marks it as most recently used. The returned identifier
+     * carries a new reference for the caller, which is given back by closing it
+     */
+    hid_t openHandle(const std::string &pathname, const H5I_type_t idType);
+    /** Close cached identifiers, least recently used first, until at most maxHandles remain */
+    void evictHandles(void);
+    /** Drop the cached identifiers of the given absolute pathname and everything below it */
+    void dropHandles(const std::string &pathname);
+    /** Cached properties of the dataset at the given absolute pathname, NULL if not known */
+    const DatasetInfo* datasetInfo(const std::string &pathname) const;
+    /** Store the properties of a dataset next to its cached identifier, if it is cached */
+    void setDatasetInfo(const std::string &pathname, const DatasetInfo &info);
+
     /** Initializes this object */
     void init(const char* filename, bool readOnly = false);
 
+    /** Create a new dataset with the given HDF5 element type */
+    HDF5Dataset* createTypedDataset(std::string name, int nDims, size_t* dims, hid_t type, const HDF5DatasetOptions &options);
+
 protected:
 	/** Remove object from object stack */
     void removeObject(HDF5Object *obj);
@@ -124,6 +299,9 @@ public:
     HDF5File(HDF5File &file);
     virtual ~HDF5File();
 
+    /** Default maximum number of cached group and dataset handles */
+    static const size_t DEFAULT_MAX_HANDLES = 64;
+
 	/** Close file. This is automaticall called when the instance is deleted */
     void close(void);
     /** @return only the name of the HDF5 file */
@@ -131,7 +309,20 @@ public:
     /** @return the full pathname of the file */
     std::string pathname();
 
+    /**
+     * Set the maximum number of cached group and dataset handles. Evicting a handle only gives
+     * back the reference of the cache, instances obtained from group or dataset stay usable
+     */
+    void setMaxHandles(const size_t maxHandles);
+    /** @return the maximum number of cached handles */
+    size_t maxHandles(void) const { return this->_maxHandles; }
+    /** @return the number of currently cached handles */
+    size_t cachedHandles(void) const { return this->_handles.size(); }
+
     /** Get group with the given name
+     * Every call returns a new instance that belongs to the caller and may be closed or deleted
+     * independently of other instances of the same object. The underlying HDF5 identifiers are
+     * cached by their absolute pathname, so repeated calls do not reopen the object
      @throws HDF5Exception Thrown if an error occurs and if the dataset does not exists
     */
     HDF5Group* group(std::string name);
@@ -139,7 +330,10 @@ public:
      @throws HDF5Exception Thrown if an error occurs and if the dataset does not exists
     */
     HDF5Group* rootGroup();
-    /** Get dataset with the given name
+    /** Get dataset with the given name. The instance is cached like in group
+     * The datatype, rank and maximum dimensions are cached with the identifier. The dimensions
+     * are read from the file for every new instance and are not updated afterwards: rows that
+     * another instance appends later, or still buffers, are not seen by this instance
      @throws HDF5Exception Thrown if an error occurs and if the dataset does not exists
     */
     HDF5Dataset* dataset(std::string name);
@@ -163,6 +357,39 @@ public:
      */
     HDF5Dataset* createDataset(std::string name, int nDims, size_t* dims, int flags = 0);
 
+    /**
+     * Create new dataset with element type T (double, float, int32_t, int64_t or uint8_t)
+     * stored as the matching native HDF5 type. See createDataset
+     */
+    template <class T>
+    HDF5Dataset* createDataset(std::string name, int nDims, size_t* dims, int flags = 0) {
+    	(void)flags;
+    	return this->createTypedDataset(name, nDims, dims, NativeType<T>::type(), HDF5DatasetOptions());
+    }
+
+    /**
+     * Create new double dataset with the given creation options (chunking, fill value, filters)
+     * @throws HDF5Exception Thrown if an error occurs while create the dataset
+     * @returns the opened, created dataset
+     */
+    HDF5Dataset* createDataset(std::string name, int nDims, size_t* dims, const HDF5DatasetOptions &options);
+
+    /** Create new dataset with element type T and the given creation options */
+    template <class T>
+    HDF5Dataset* createDataset(std::string name, int nDims, size_t* dims, const HDF5DatasetOptions &options) {
+    	return this->createTypedDataset(name, nDims, dims, NativeType<T>::type(), options);
+    }
+
+    /**
+     * Write the levels of a multi-resolution pyramid as a group of datasets
+     * @param name Name or absolute path of the new group
+     * @param levels Levels, finest first. See HDF5Group::createLevelSet
+     * @throws HDF5Exception Thrown if an error occurs while writing
+     * @returns Instance of the created group
+     */
+    template <class T>
+    HDF5Group* createLevelSet(std::string name, const std::vector<numeric::Cube<T> > &levels);
+
     friend class HDF5Object;
     friend class HDF5Group;
     friend class HDF5Dataset;
@@ -401,6 +628,12 @@ public:
 
 	/** Close the given object. */
     virtual void close(void) {};
+    /**
+     * Close and delete an instance obtained from HDF5File::group or HDF5File::dataset, which
+     * must not be used anymore. The identifier stays in the handle cache of the file, so the
+     * next lookup of the same object is cheap. Has no effect on the root group
+     */
+    void release(void);
     /** @return true if the object is closed */
     virtual bool isClosed(void);
     /** @return true if the object is not closed */
@@ -449,6 +682,7 @@ public:
     /** @return true if this object is an attribute */
     bool isAttribute(void);
 
+    friend class HDF5File;
     friend class HDF5Attribute;
 	friend class HDF5AttributeManager;
 };
@@ -456,8 +690,8 @@ public:
 /** HDF5 group */
 class HDF5Group : public HDF5Object {
 protected:
-	/** Internal constructor to create a group from a HDF5 file */
-    HDF5Group(HDF5File *file, std::string name);
+	/** Internal constructor to create a group from a HDF5 file. Takes over id if given, otherwise the group is opened */
+    HDF5Group(HDF5File *file, std::string name, hid_t id = 0);
 
 	/** @return The relative path of the group */
     std::string relativePath(std::string name);
@@ -500,13 +734,44 @@ public:
      */
     HDF5Dataset* createDataset(std::string name, int nDims, size_t* dims, int flags = 0);
 
+    /**
+     * Create new dataset with element type T (double, float, int32_t, int64_t or uint8_t)
+     * stored as the matching native HDF5 type. See createDataset
+     */
+    template <class T>
+    HDF5Dataset* createDataset(std::string name, int nDims, size_t* dims, int flags = 0) {
+    	if(name.length() == 0) throw HDF5Exception("Empty dataset pathname");
+    	return this->_file->createDataset<T>(this->relativePath(name), nDims, dims, flags);
+    }
+
+    /** Create new double dataset with the given creation options, see HDF5File::createDataset */
+    HDF5Dataset* createDataset(std::string name, int nDims, size_t* dims, const HDF5DatasetOptions &options);
+
+    /** Create new dataset with element type T and the given creation options */
+    template <class T>
+    HDF5Dataset* createDataset(std::string name, int nDims, size_t* dims, const HDF5DatasetOptions &options) {
+    	if(name.length() == 0) throw HDF5Exception("Empty dataset pathname");
+    	return this->_file->createDataset<T>(this->relativePath(name), nDims, dims, options);
+    }
+
+    /**
+     * Write the levels of a multi-resolution pyramid (e.g. numeric::Pyramid::levels()) as a
+     * new sub-group with the datasets "level1", "level2", ..., where level i is downsampled
+     * by 2^i. The group gets a "levels" attribute, each dataset a "scale" attribute. The
+     * datasets have the element type T, see createDataset<T>
+     * @param name Name or absolute path of the new group
+     * @param levels Levels, finest first
+     * @throws HDF5Exception Thrown if an error occurs while writing
+     * @returns Instance of the created group
+     */
+    template <class T>
+    HDF5Group* createLevelSet(std::string name, const std::vector<numeric::Cube<T> > &levels);
+
     friend class HDF5File;
 };
 
 class HDF5Dataset : public HDF5Object {
 protected:
-	/** Datatype of the dataset */
-    hid_t       d_datatype;
     /** Class type */
     H5T_class_t d_class;
     /** Ordering */
@@ -519,8 +784,180 @@ protected:
     /** Dimension size array */
     hsize_t    *d_dims;
 
-	/** Internal constructor for creating a new dataset */
-    HDF5Dataset(HDF5File *file, std::string pathname);
+    /** Maximum extent of the leading dimension */
+    hsize_t     d_maxRows;
+    /** Number of leading-dimension rows of a chunk, 0 if not yet queried */
+    hsize_t     d_chunkRows;
+    /** Appended rows not yet written, starting at row d_dims[0] - d_pendingRows */
+    std::vector<char> d_pending;
+    hsize_t     d_pendingRows;
+    /** Memory type of the pending rows */
+    hid_t       d_pendingType;
+
+    /** Cached file dataspace, 0 if not opened */
+    hid_t       d_space;
+
+    /** Memory dataspace of a given shape */
+    struct MemSpace {
+    	int rank;
+    	hsize_t dims[H5S_MAX_RANK];
+    	hid_t id;
+    };
+    /** Recently used memory dataspaces, most recent first */
+    std::vector<MemSpace> d_memSpaces;
+    /** Maximum number of cached memory dataspaces */
+    static const size_t MEMSPACE_CACHE = 8;
+
+    /** Cached file dataspace. Every transfer sets its own selection on it */
+    hid_t fileSpace(void);
+    /** Close the cached file dataspace, e.g. after the extent changed */
+    void closeSpaces(void);
+    /** Cached memory dataspace of the given shape */
+    hid_t memSpace(const int rank, const hsize_t* dims);
+    /** Close all cached memory dataspaces */
+    void closeMemSpaces(void);
+    /**
+     * Read or write the hyperslab at offset (the whole dataset if NULL) with the given count,
+     * stride and block, using the cached dataspaces. Returns the number of elements transferred
+     */
+    size_t transfer(const bool write, hid_t memtype, void *buf, const size_t n, const size_t* count, const size_t* offset = NULL, const size_t* stride = NULL, const size_t* block = NULL);
+    /** Read the values at count points of the given memory type */
+    size_t readPointsRaw(hid_t memtype, void *buf, const size_t* coords, const size_t count);
+
+	/** Internal constructor for creating a new dataset. Takes over id if given, otherwise the dataset is opened */
+    HDF5Dataset(HDF5File *file, std::string pathname, hid_t id = 0);
+
+    /** Number of cells of one row along the leading dimension */
+    size_t rowCells(void);
+    /** Set the extent of the leading dimension in the file to the given number of rows */
+    void extendRows(const hsize_t rows);
+    /** Append count rows of the given memory type */
+    void appendRaw(hid_t memtype, const void *buf, const size_t count);
+    /** Write the pending appended rows */
+    void writePending(void);
+
+    /**
+     * Read n-dimensional data of the given memory type. dims is the hyperslab count, which is
+     * selected at offset with the given stride and block if offset is not NULL.
+     * Returns the number of elements read
+     */
+    size_t readRaw(hid_t memtype, void *buf, const size_t n, const size_t* dims, const size_t* offset = NULL, const size_t* stride = NULL, const size_t* block = NULL);
+    /** Write n-dimensional data of the given memory type, see readRaw. Returns the number of elements written */
+    size_t writeRaw(hid_t memtype, const void *buf, const size_t n, const size_t* dims, const size_t* offset = NULL, const size_t* stride = NULL, const size_t* block = NULL);
+    /** Throw if the region is not within the dataset */
+    void checkRegion(const size_t n, const size_t* offset, const size_t* count, const size_t* stride, const size_t* block);
+    /** Number of blocks of a region with the size of a cube. Throws if the cube size is not a multiple of block */
+    static void cubeRegion(const size_t nx, const size_t ny, const size_t nz, const size_t* block, size_t* count);
+
+    /** Maximum size of the slab buffer of transferReversed in bytes */
+    static const size_t SLAB_BYTES = 4*1024*1024;
+    /** Number of cells along the first dimension per slab of transferReversed */
+    static const size_t SLAB_RUN = 32;
+
+    /**
+     * Read the whole dataset into data, or write data to the whole dataset, with the axes
+     * reversed, i.e. the first dimension of the dataset is the fastest in data. HDF5 cannot
+     * describe this permutation with a memory dataspace, so slabs of up to SLAB_RUN cells along
+     * the first dimension (and as much of the second dimension as fits into SLAB_BYTES) are
+     * transferred through a buffer, and the permutation moves runs of SLAB_RUN contiguous values.
+     * If offset is not NULL, only the hyperslab region (offset, count, stride, block) is
+     * transferred, see readRegion, and data holds its cells densely packed.
+     * data is not modified when writing
+     */
+    template <class T>
+    void transferReversed(T* data, const bool write, const size_t* offset = NULL, const size_t* count = NULL, const size_t* stride = NULL, const size_t* block = NULL) {
+    	const int rank = this->d_rank;
+    	// Region in the file, the whole dataset by default
+    	size_t roff[H5S_MAX_RANK], rcnt[H5S_MAX_RANK], rstr[H5S_MAX_RANK], rblk[H5S_MAX_RANK];
+    	size_t dims[H5S_MAX_RANK];
+    	for(int i=0;i<rank;i++) {
+    		roff[i] = (offset == NULL) ? 0 : offset[i];
+    		rcnt[i] = (offset == NULL) ? this->d_dims[i] : count[i];
+    		rstr[i] = (stride == NULL) ? 1 : stride[i];
+    		rblk[i] = (block == NULL) ? 1 : block[i];
+    		dims[i] = rcnt[i]*rblk[i];
+    	}
+    	if(rank == 1) {
+    		if(write) this->writeRaw(NativeType<T>::type(), data, 1, rcnt, offset, stride, block);
+    		else this->readRaw(NativeType<T>::type(), data, 1, rcnt, offset, stride, block);
+    		return;
+    	}
+    	size_t inner = 1;
+    	for(int i=2;i<rank;i++) inner *= dims[i];
+    	if(dims[0] == 0 || dims[1] == 0 || inner == 0) return;
+    	// Stride of the reversed data along every dimension
+    	size_t dstride[H5S_MAX_RANK];
+    	dstride[0] = 1;
+    	for(int i=1;i<rank;i++) dstride[i] = dstride[i-1]*dims[i-1];
+    	const size_t k = std::min(dims[0], (size_t)SLAB_RUN);
+    	const size_t kb = std::max((size_t)1, std::min(dims[1], SLAB_BYTES/(k*inner*sizeof(T))));
+    	std::vector<T> buf(k*kb*inner);
+    	// Hyperslab of the slab. The inner dimensions are selected completely, the first two
+    	// dimensions in pieces of whole blocks, or of a part of a single block
+    	size_t soff[H5S_MAX_RANK], scnt[H5S_MAX_RANK], sstr[H5S_MAX_RANK], sblk[H5S_MAX_RANK], sdims[H5S_MAX_RANK];
+    	for(int i=2;i<rank;i++) {
+    		soff[i] = roff[i];
+    		scnt[i] = rcnt[i];
+    		sstr[i] = rstr[i];
+    		sblk[i] = rblk[i];
+    		sdims[i] = dims[i];
+    	}
+    	size_t a0 = 0;
+    	while(a0 < dims[0]) {
+    		this->slabPiece(0, a0, k, roff, rcnt, rstr, rblk, soff, scnt, sstr, sblk, sdims);
+    		size_t b0 = 0;
+    		while(b0 < dims[1]) {
+    			this->slabPiece(1, b0, kb, roff, rcnt, rstr, rblk, soff, scnt, sstr, sblk, sdims);
+    			if(!write) this->readRaw(NativeType<T>::type(), buf.data(), rank, scnt, soff, sstr, sblk);
+    			// Odometer over the slab without the first dimension in file order, tracking the offset in data
+    			const size_t rest = sdims[1]*inner;
+    			size_t idx[H5S_MAX_RANK] = {0};
+    			size_t off = a0 + b0*dstride[1];
+    			for(size_t r=0;r<rest;r++) {
+    				T* p = data + off;
+    				T* q = buf.data() + r;
+    				if(write)
+    					for(size_t j=0;j<sdims[0];j++) q[j*rest] = p[j];
+    				else
+    					for(size_t j=0;j<sdims[0];j++) p[j] = q[j*rest];
+    				for(int d=rank-1;d>=1;d--) {
+    					off += dstride[d];
+    					if(++idx[d] < sdims[d]) break;
+    					off -= dstride[d]*sdims[d];
+    					idx[d] = 0;
+    				}
+    			}
+    			if(write) this->writeRaw(NativeType<T>::type(), buf.data(), rank, scnt, soff, sstr, sblk);
+    			b0 += sdims[1];
+    		}
+    		a0 += sdims[0];
+    	}
+    }
+
+    /**
+     * Select the piece of at most max cells starting at the densely packed cell p along dimension d
+     * of the region (roff, rcnt, rstr, rblk) as hyperslab (soff, scnt, sstr, sblk) with sdims[d] cells
+     */
+    static void slabPiece(const int d, const size_t p, const size_t max, const size_t* roff, const size_t* rcnt, const size_t* rstr, const size_t* rblk,
+    		size_t* soff, size_t* scnt, size_t* sstr, size_t* sblk, size_t* sdims) {
+    	const size_t c = p / rblk[d];
+    	const size_t b = p % rblk[d];
+    	sstr[d] = rstr[d];
+    	if(b != 0 || rblk[d] > max) {
+    		// Part of a single block
+    		sblk[d] = std::min(rblk[d]-b, max);
+    		scnt[d] = 1;
+    		soff[d] = roff[d] + c*rstr[d] + b;
+    	} else {
+    		sblk[d] = rblk[d];
+    		scnt[d] = std::min(max/rblk[d], rcnt[d]-c);
+    		soff[d] = roff[d] + c*rstr[d];
+    	}
+    	sdims[d] = scnt[d]*sblk[d];
+    }
+
+    /** Throw if the container dimensions differ from the dataset dimensions */
+    void checkShape(const int rank, const size_t* dims);
 
 public:
     virtual ~HDF5Dataset();
@@ -547,6 +984,28 @@ public:
     /** Total size of the whole dataset */
     size_t size(void);
 
+    /** Chunk dimensions, or an empty vector if the dataset is not chunked */
+    std::vector<size_t> chunk(void);
+
+    /** True if the leading dimension can grow, i.e. the dataset supports append */
+    bool isExtendable(void);
+
+    /**
+     * Append count rows along the leading dimension, each with the shape of the remaining
+     * dimensions. Rows are buffered until a chunk is complete, so that every chunk is written
+     * (and compressed) once. The extent in the file always matches the rows written to it;
+     * other instances of the dataset do not see buffered rows until flush/close
+     * @throws HDF5Exception Thrown if the dataset is not extendable or writing fails
+     */
+    template <class T>
+    void append(const T *buf, const size_t count) {
+    	if(this->isClosed()) throw HDF5Exception("Dataset closed");
+    	this->appendRaw(NativeType<T>::type(), buf, count);
+    }
+
+    /** Write pending appended rows */
+    void flush(void);
+
     /** True if integer type dataset (INT, LONG, ... ) */
     bool isInteger(void);
     /** True if floating point type dataset (FLOAT, DOUBLE, ...) */
@@ -572,6 +1031,22 @@ public:
      */
     double read_2d(size_t x, size_t y);
 
+    /**
+     * Read the values at count arbitrary points with a single element selection, which is
+     * much faster than reading the points one by one. The points are read in file order
+     * and returned in the given order
+     * @param buf Destination buffer for count values, in the order of the points
+     * @param coords Coordinates of the points, dims() per point: point i is at coords[i*dims()]
+     * @param count Number of points
+     * @returns number of elements read
+     * @throws HDF5Exception Thrown if a point is outside of the dataset or reading fails
+     */
+    template <class T>
+    size_t readPoints(T *buf, const size_t* coords, const size_t count) {
+    	if(this->isClosed()) throw HDF5Exception("Dataset closed");
+    	return this->readPointsRaw(NativeType<T>::type(), buf, coords, count);
+    }
+
     /**
      * @brief read Reads a single datapoint out of the dataset
      * @param x X coordinate to be read
@@ -593,11 +1068,194 @@ public:
      */
     size_t read(double*& array);
 
+    /** Reads n-dimensional values of type T (double, float, int32_t, int64_t or uint8_t).
+     * The data is converted by HDF5 only if the dataset has a different type
+    @param buf Destination buffer as 1d array
+    @param n Number of dimensions to be read
+    @param dims Dimension array, determining the number of cells in each dimension
+    */
+    template <class T>
+    size_t read(T *buf, const size_t n, const size_t* dims) {
+    	if(this->isClosed()) throw HDF5Exception("Dataset closed");
+    	return this->readRaw(NativeType<T>::type(), buf, n, dims);
+    }
+
+	/**
+	 * Writes n-dimensional values of type T (double, float, int32_t, int64_t or uint8_t)
+	 * @param array Source buffer as 1d array
+	 * @param n Number of dimensions to be written
+	 * @param dims Dimension array, determining the number of cells in each dimension
+	 * @return number of elements written
+	 */
+    template <class T>
+    size_t write(const T *array, const size_t n, const size_t* dims) {
+    	if(this->isClosed()) throw HDF5Exception("Dataset closed");
+    	return this->writeRaw(NativeType<T>::type(), array, n, dims);
+    }
+
+	/**
+	 * Writes the given array of type T of the size n to a one-dimensional dataset
+	 * @return number of elements written
+	 */
+    template <class T>
+    size_t write(const T *array, const size_t n) {
+    	const size_t dims[1] = { n };
+    	return this->write(array, 1, dims);
+    }
+
+    /**
+     * Read a hyperslab region into buf. In every dimension i, count[i] blocks of block[i] cells
+     * are read, starting at offset[i] and stride[i] cells apart; stride and block default to 1.
+     * The selected cells are packed densely into buf, which must hold prod(count[i]*block[i])
+     * values. Only the selected part of the dataset is read from the file
+     * @param n Number of dimensions, must match the dataset rank
+     * @returns number of elements read
+     * @throws HDF5Exception Thrown if the region exceeds the dataset or reading fails
+     */
+    template <class T>
+    size_t readRegion(T *buf, const size_t n, const size_t* offset, const size_t* count, const size_t* stride = NULL, const size_t* block = NULL) {
+    	this->checkRegion(n, offset, count, stride, block);
+    	return this->readRaw(NativeType<T>::type(), buf, n, count, offset, stride, block);
+    }
+
+    /** Write the densely packed buf to a hyperslab region, see readRegion */
+    template <class T>
+    size_t writeRegion(const T *buf, const size_t n, const size_t* offset, const size_t* count, const size_t* stride = NULL, const size_t* block = NULL) {
+    	this->checkRegion(n, offset, count, stride, block);
+    	return this->writeRaw(NativeType<T>::type(), buf, n, count, offset, stride, block);
+    }
+
+    /**
+     * Read the region of a 3d dataset starting at offset with the size of the given cube,
+     * e.g. a single plane into a Cube with one cell along the plane normal. With block, the
+     * cube size along every dimension i must be a multiple of block[i] and count[i] blocks
+     * are read. Indices map like in readCube, and the region is read in slabs through a
+     * bounded buffer like read(Cube&)
+     */
+    template <class T>
+    void readRegion(numeric::Cube<T> &cube, const size_t* offset, const size_t* stride = NULL, const size_t* block = NULL) {
+    	size_t count[3];
+    	this->cubeRegion(cube.size(0), cube.size(1), cube.size(2), block, count);
+    	this->checkRegion(3, offset, count, stride, block);
+    	this->transferReversed(cube.data(), false, offset, count, stride, block);
+    }
+
+    /** Write the cube to the region of a 3d dataset starting at offset, see readRegion */
+    template <class T>
+    void writeRegion(const numeric::Cube<T> &cube, const size_t* offset, const size_t* stride = NULL, const size_t* block = NULL) {
+    	size_t count[3];
+    	this->cubeRegion(cube.size(0), cube.size(1), cube.size(2), block, count);
+    	this->checkRegion(3, offset, count, stride, block);
+    	this->transferReversed(const_cast<T*>(cube.data()), true, offset, count, stride, block);
+    }
+
     /** Read datacube */
     numeric::Cube<double> readCube();
     /** Write datacube */
 	void writeCube(const numeric::Cube<double> &cube);
 
+	/** Read datacube of type T */
+	template <class T>
+	numeric::Cube<T> readCube() {
+		if(this->isClosed()) throw HDF5Exception("Dataset closed");
+		if(this->d_rank != 3) throw HDF5Exception("Cannot read cube from not-3d dataset");
+		numeric::Cube<T> result(this->d_dims[0], this->d_dims[1], this->d_dims[2]);
+		this->transferReversed(result.data(), false);
+		return result;
+	}
+
+	/**
+	 * Read a 2d dataset into the matrix, which is resized if necessary. m(x,y) is the value
+	 * at [y][x] like in read_2d, which is the storage order of the matrix, so the data is
+	 * read directly into the matrix storage
+	 */
+	template <class T>
+	void read(numeric::Matrix<T> &m) {
+		if(this->isClosed()) throw HDF5Exception("Dataset closed");
+		if(this->d_rank != 2) throw HDF5Exception("Cannot read matrix from not-2d dataset");
+		const size_t dims[2] = {this->d_dims[0], this->d_dims[1]};
+		if(m.size(0) != dims[1] || m.size(1) != dims[0]) m.resize(dims[1], dims[0]);
+		this->read(m.data(), 2, dims);
+	}
+
+	/**
+	 * Read a 3d dataset into the cube, which is resized if necessary. Indices map like in readCube.
+	 * The axes are reversed in slabs through a bounded buffer, like in readRegion(Cube&), and no
+	 * full-size copy of the data is made
+	 */
+	template <class T>
+	void read(numeric::Cube<T> &c) {
+		if(this->isClosed()) throw HDF5Exception("Dataset closed");
+		if(this->d_rank != 3) throw HDF5Exception("Cannot read cube from not-3d dataset");
+		if(c.size(0) != this->d_dims[0] || c.size(1) != this->d_dims[1] || c.size(2) != this->d_dims[2])
+			c.resize(this->d_dims[0], this->d_dims[1], this->d_dims[2]);
+		this->transferReversed(c.data(), false);
+	}
+
+	/** Read a 4d dataset into the tesseract, which is resized if necessary. t(i,j,k,l) is the value at [i][j][k][l] */
+	template <class T>
+	void read(numeric::Tesseract<T> &t) {
+		if(this->isClosed()) throw HDF5Exception("Dataset closed");
+		if(this->d_rank != 4) throw HDF5Exception("Cannot read tesseract from not-4d dataset");
+		if(t.size(0) != this->d_dims[0] || t.size(1) != this->d_dims[1] || t.size(2) != this->d_dims[2] || t.size(3) != this->d_dims[3])
+			t.resize(this->d_dims[0], this->d_dims[1], this->d_dims[2], this->d_dims[3]);
+		this->transferReversed(t.data(), false);
+	}
+
+	/**
+	 * Write datacube of type T to a dataset of the same dimensions. Indices map like in readCube.
+	 * The data is written in slabs through a bounded buffer instead of a full copy, like in
+	 * writeRegion(const Cube&)
+	 */
+	template <class T>
+	void writeCube(const numeric::Cube<T> &cube) {
+		if(this->isClosed()) throw HDF5Exception("Dataset closed");
+		const size_t dims[3] = { cube.size(0), cube.size(1), cube.size(2) };
+		this->checkShape(3, dims);
+		this->transferReversed(const_cast<T*>(cube.data()), true);
+	}
+
+	/** Write a cube, see writeCube */
+	template <class T>
+	void write(const numeric::Cube<T> &cube) { this->writeCube(cube); }
+
+	/** Write a tesseract to a 4d dataset of the same dimensions. Indices map like in read(Tesseract&) */
+	template <class T>
+	void write(const numeric::Tesseract<T> &t) {
+		if(this->isClosed()) throw HDF5Exception("Dataset closed");
+		const size_t dims[4] = { t.size(0), t.size(1), t.size(2), t.size(3) };
+		this->checkShape(4, dims);
+		this->transferReversed(const_cast<T*>(t.data()), true);
+	}
+
+	/** Write a matrix to a 2d dataset with the dimensions (m.size(1), m.size(0)) directly from its storage, see read(Matrix&) */
+	template <class T>
+	void write(const numeric::Matrix<T> &m) {
+		if(this->isClosed()) throw HDF5Exception("Dataset closed");
+		const size_t dims[2] = { m.size(1), m.size(0) };
+		this->checkShape(2, dims);
+		this->write(m.data(), 2, dims);
+	}
+
+	/** Write an array to a 1d dataset of the same size directly from its storage */
+	template <class T>
+	size_t write(const numeric::Array<T> &array) {
+		if(this->isClosed()) throw HDF5Exception("Dataset closed");
+		const size_t dims[1] = { array.size() };
+		this->checkShape(1, dims);
+		return this->write(array.data(), array.size());
+	}
+
+	/** Write a valarray to a 1d dataset of the same size directly from its storage */
+	template <class T>
+	size_t write(const std::valarray<T> &array) {
+		if(this->isClosed()) throw HDF5Exception("Dataset closed");
+		const size_t dims[1] = { array.size() };
+		this->checkShape(1, dims);
+		if(array.size() == 0) return 0;
+		return this->write(&array[0], array.size());
+	}
+
 	/**
 	 * Write array
 	 */
@@ -672,6 +1330,26 @@ public:
 };
 
 
+template <class T>
+HDF5Group* HDF5File::createLevelSet(std::string name, const std::vector<numeric::Cube<T> > &levels) {
+	return this->rootGroup()->createLevelSet(name, levels);
+}
+
+template <class T>
+HDF5Group* HDF5Group::createLevelSet(std::string name, const std::vector<numeric::Cube<T> > &levels) {
+	HDF5Group* group = this->createGroup(name);
+	group->attrs.create("levels", (int)levels.size());
+	for(size_t i=0;i<levels.size();i++) {
+		const numeric::Cube<T> &level = levels[i];
+		size_t dims[3] = { level.size(0), level.size(1), level.size(2) };
+		HDF5Dataset* dataset = group->createDataset<T>("level" + std::to_string(i+1), 3, dims);
+		dataset->writeCube(level);
+		dataset->attrs.create("scale", (long)(2L << i));
+		dataset->release();
+	}
+	return group;
+}
+
 }
 
 #endif
@@ -0,0 +1,914 @@
+/* =============================================================================
+ *
+ * Title:         HDF5 wrapper test program
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2019 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ *
+ * =============================================================================
+ */
+
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <valarray>
+#include <limits>
+#include <type_traits>
+
+#include <sys/resource.h>
+
+#include "hdf5.hpp"
+#include "pyramid.hpp"
+
+using namespace std;
+using namespace hdf5;
+
+#define TEST_FILE "hdf5test.h5"
+
+
+/* ==== Tests that should be implemented using gtest ======================== */
+
+static void test_append_limited() {
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	size_t dims[1] = {0};
+	HDF5DatasetOptions options;
+	options.maxDims = std::vector<size_t>{1000};
+	options.chunked(std::vector<size_t>{64});
+	HDF5Dataset* ds = file.createDataset("limited", 1, dims, options);
+	std::vector<double> rows(1000);
+	for(size_t i=0;i<rows.size();i++) rows[i] = (double)i;
+
+	// Grow in uneven steps with reads in between, which flush the pending rows while the
+	// capacity reserved ahead already reaches the maximum dimension
+	size_t count = 0;
+	const size_t steps[] = {1, 99, 500, 150, 250};
+	for(size_t s=0;s<sizeof(steps)/sizeof(size_t);s++) {
+		ds->append(&rows[count], steps[s]);
+		count += steps[s];
+		std::vector<double> back(count);
+		const size_t shape[1] = {count};
+		ds->read(back.data(), 1, shape);
+		if(back[count-1] != (double)(count-1) || ds->dims(0) != count) {
+			cerr << "Append to limited dataset error after " << count << " rows" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(count != 1000) {
+		cerr << "Append test does not reach the maximum dimension" << endl;
+		exit(EXIT_FAILURE);
+	}
+	try {
+		ds->append(&rows[0], 1);
+		cerr << "Append beyond the maximum dimension did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+
+	// Contiguous datasets cannot grow at all
+	dims[0] = 4;
+	HDF5Dataset* fixed = file.createDataset("fixed", 1, dims);
+	try {
+		fixed->append(&rows[0], 1);
+		cerr << "Append to a contiguous dataset did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+static double region_value(const size_t x, const size_t y, const size_t z) {
+	return (double)(x*1000000 + y*1000 + z);
+}
+
+static void test_append_second_holder() {
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	size_t dims[1] = {0};
+	HDF5DatasetOptions options;
+	options.unlimited();
+	options.chunked(std::vector<size_t>{64});
+	HDF5Dataset* ds = file.createDataset("x", 1, dims, options);
+	std::vector<double> rows(266);
+	for(size_t i=0;i<rows.size();i++) rows[i] = (double)(i+1);
+
+	ds->append(&rows[0], 192);
+	ds->append(&rows[192], 64);
+	ds->append(&rows[256], 10);
+	// The 10 rows after the last chunk are still buffered. A second holder sees exactly the
+	// rows in the file and no fill values beyond them
+	HDF5Dataset* other = file.dataset("x");
+	if(other->dims(0) != 256) {
+		cerr << "Second holder sees " << other->dims(0) << " rows during append instead of 256" << endl;
+		exit(EXIT_FAILURE);
+	}
+	std::vector<double> back(256);
+	other->read_1d(back.data(), back.size());
+	for(size_t i=0;i<back.size();i++)
+		if(back[i] != rows[i]) {
+			cerr << "Second holder reads " << back[i] << " at row " << i << " during append" << endl;
+			exit(EXIT_FAILURE);
+		}
+	delete other;
+
+	ds->flush();
+	other = file.dataset("x");
+	if(other->dims(0) != 266) {
+		cerr << "Second holder sees " << other->dims(0) << " rows after flush instead of 266" << endl;
+		exit(EXIT_FAILURE);
+	}
+	file.close();
+	remove(TEST_FILE);
+}
+
+static void test_region_cube() {
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	// Large enough that the region is split into several slabs along the first two dimensions,
+	// some of them in the middle of a block
+	const size_t nx = 90, ny = 90, nz = 512;
+	numeric::Cube<double> cube(nx, ny, nz);
+	for(size_t x=0;x<nx;x++)
+		for(size_t y=0;y<ny;y++)
+			for(size_t z=0;z<nz;z++) cube(x,y,z) = region_value(x,y,z);
+	size_t dims[3] = {nx, ny, nz};
+	HDF5Dataset* ds = file.createDataset("cube", 3, dims);
+	ds->write(cube);
+
+	const size_t offset[3] = {3, 1, 0};
+	const size_t stride[3] = {45, 9, 1};
+	const size_t block[3] = {40, 7, 1};
+	// 2 blocks of 40 cells in x, 9 blocks of 7 cells in y and all cells in z
+	numeric::Cube<double> region(80, 63, nz);
+	ds->readRegion(region, offset, stride, block);
+	for(size_t x=0;x<80;x++)
+		for(size_t y=0;y<63;y++)
+			for(size_t z=0;z<nz;z++) {
+				const size_t fx = offset[0] + (x/block[0])*stride[0] + x%block[0];
+				const size_t fy = offset[1] + (y/block[1])*stride[1] + y%block[1];
+				if(region(x,y,z) != region_value(fx,fy,z)) {
+					cerr << "Cube region read error at " << x << "," << y << "," << z << endl;
+					exit(EXIT_FAILURE);
+				}
+			}
+
+	// Write the negated region back and check that exactly the region changed
+	for(size_t i=0;i<region.size();i++) region.data()[i] = -region.data()[i];
+	ds->writeRegion(region, offset, stride, block);
+	numeric::Cube<double> back;
+	ds->read(back);
+	for(size_t x=0;x<nx;x++)
+		for(size_t y=0;y<ny;y++) {
+			const bool inx = x >= offset[0] && (x-offset[0])%stride[0] < block[0] && (x-offset[0])/stride[0] < 2;
+			const bool iny = y >= offset[1] && (y-offset[1])%stride[1] < block[1] && (y-offset[1])/stride[1] < 9;
+			const double sign = (inx && iny) ? -1.0 : 1.0;
+			for(size_t z=0;z<nz;z++)
+				if(back(x,y,z) != sign*region_value(x,y,z)) {
+					cerr << "Cube region write error at " << x << "," << y << "," << z << endl;
+					exit(EXIT_FAILURE);
+				}
+		}
+
+	// The cube size must be a multiple of the block
+	numeric::Cube<double> odd(81, 63, nz);
+	try {
+		ds->readRegion(odd, offset, stride, block);
+		cerr << "Region with a partial block did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+static void test_handle_cache() {
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	size_t dims[1] = {4};
+	const double values[4] = {1.0, 2.0, 3.0, 4.0};
+	file.createGroup("g");
+	file.createDataset("g/d", 1, dims)->write(values, 4);
+
+	// Two holders of the same dataset, one of them closes and the other deletes its instance
+	HDF5Dataset* a = file.dataset("/g/d");
+	HDF5Dataset* b = file.group("g")->dataset("d");
+	if(a == b) {
+		cerr << "Lookups of the same dataset share an instance" << endl;
+		exit(EXIT_FAILURE);
+	}
+	a->close();
+	double back[4] = {0};
+	b->read_1d(back, 4);
+	if(b->isClosed() || back[3] != 4.0) {
+		cerr << "Closing one holder of a dataset affects another holder" << endl;
+		exit(EXIT_FAILURE);
+	}
+	HDF5Dataset* c = file.dataset("g/d");
+	delete b;
+	c->read_1d(back, 4);
+	if(back[0] != 1.0) {
+		cerr << "Deleting one holder of a dataset affects another holder" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// The root group is never handed out by group
+	HDF5Group* root = file.group("/");
+	if(root == file.rootGroup()) {
+		cerr << "group(\"/\") returns the root group instance" << endl;
+		exit(EXIT_FAILURE);
+	}
+	delete root;
+	if(file.rootGroup()->getSubGroups().size() != 1) {
+		cerr << "Deleting a root group lookup closes the root group" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Evicted handles stay valid for their holders
+	for(size_t i=0;i<10;i++) file.createDataset("g/e" + std::to_string(i), 1, dims)->release();
+	file.setMaxHandles(2);
+	if(file.cachedHandles() > 2) {
+		cerr << "Handle cache exceeds its maximum size" << endl;
+		exit(EXIT_FAILURE);
+	}
+	c->read_1d(back, 4);
+	if(back[1] != 2.0) {
+		cerr << "Evicting a handle affects its holders" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Lookups take the datatype and maximum extent from the cache, but read the current dimensions
+	file.setMaxHandles(HDF5File::DEFAULT_MAX_HANDLES);
+	dims[0] = 0;
+	HDF5Dataset* log = file.createDataset<float>("g/log", 1, dims, HDF5DatasetOptions().unlimited().chunked(std::vector<size_t>{2}));
+	const float rows[4] = {1.0f, 2.0f, 3.0f, 4.0f};
+	for(size_t i=0;i<2;i++) {
+		log->append(&rows[2*i], 2);
+		HDF5Dataset* lookup = file.dataset("g/log");
+		if(lookup->dims(0) != 2*(i+1) || !lookup->isFloat() || lookup->typeSize() != sizeof(float) || !lookup->isExtendable()) {
+			cerr << "Lookup of a cached dataset has wrong properties after " << 2*(i+1) << " rows" << endl;
+			exit(EXIT_FAILURE);
+		}
+		delete lookup;
+	}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+static void test_level_set() {
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	numeric::Cube<float> src(21, 16, 8);
+	for(size_t i=0;i<src.size();i++) src[i] = (float)i;
+	const numeric::Pyramid<float> pyramid(src);
+	numeric::Cube<uint8_t> bytes(8, 8, 8);
+	bytes = (uint8_t)200;
+	const numeric::Pyramid<uint8_t> bytePyramid(bytes);
+	file.createLevelSet("quicklook", pyramid.levels());
+	file.createLevelSet("bytes", bytePyramid.levels());
+
+	HDF5Group* group = file.group("quicklook");
+	if(group->attrs.readInt("levels") != (int)pyramid.depth()) {
+		cerr << "Level set has the wrong number of levels" << endl;
+		exit(EXIT_FAILURE);
+	}
+	for(size_t l=0;l<pyramid.depth();l++) {
+		HDF5Dataset* ds = group->dataset("level" + std::to_string(l+1));
+		numeric::Cube<float> back;
+		ds->read(back);
+		if(!ds->isFloat() || ds->typeSize() != sizeof(float) || ds->attrs.readLong("scale") != (long)numeric::Pyramid<float>::scale(l)) {
+			cerr << "Level " << l+1 << " of a float level set has the wrong type or scale" << endl;
+			exit(EXIT_FAILURE);
+		}
+		for(size_t i=0;i<back.size();i++)
+			if(back[i] != pyramid[l][i]) {
+				cerr << "Level " << l+1 << " of a float level set differs at " << i << endl;
+				exit(EXIT_FAILURE);
+			}
+		delete ds;
+	}
+	HDF5Dataset* ds = file.dataset("bytes/level1");
+	numeric::Cube<uint8_t> back;
+	ds->read(back);
+	if(!ds->isInteger() || ds->typeSize() != 1 || back(3,2,1) != 200) {
+		cerr << "uint8_t level set error" << endl;
+		exit(EXIT_FAILURE);
+	}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+/** Filter settings of the round trip test and the benchmark */
+static std::vector<std::pair<std::string, HDF5DatasetOptions> > filter_settings() {
+	std::vector<std::pair<std::string, HDF5DatasetOptions> > settings;
+	const std::vector<size_t> chunk{32, 256};
+	settings.push_back(std::make_pair("chunked", HDF5DatasetOptions().chunked(chunk)));
+	settings.push_back(std::make_pair("checksum", HDF5DatasetOptions().chunked(chunk).checksum()));
+	settings.push_back(std::make_pair("deflate 1 without shuffle", HDF5DatasetOptions().chunked(chunk).compressed(1, false)));
+	settings.push_back(std::make_pair("deflate 4", HDF5DatasetOptions().chunked(chunk).compressed()));
+	settings.push_back(std::make_pair("deflate 9", HDF5DatasetOptions().chunked(chunk).compressed(9)));
+	settings.push_back(std::make_pair("deflate 4 with checksum", HDF5DatasetOptions().chunked(chunk).compressed().checksum()));
+	return settings;
+}
+
+/** Smooth, compressible test data */
+static void filter_data(std::vector<double> &data, const size_t rows, const size_t cols) {
+	data.resize(rows*cols);
+	for(size_t i=0;i<rows;i++)
+		for(size_t j=0;j<cols;j++) data[i*cols+j] = floor(1000.0*sin(0.01*i)*cos(0.003*j));
+}
+
+static void test_filters() {
+	remove(TEST_FILE);
+	const size_t rows = 256, cols = 1024;
+	std::vector<double> data;
+	filter_data(data, rows, cols);
+	const std::vector<std::pair<std::string, HDF5DatasetOptions> > settings = filter_settings();
+	size_t dims[2] = {rows, cols};
+	{
+		HDF5File file(TEST_FILE);
+		for(size_t s=0;s<settings.size();s++) file.createDataset("d" + std::to_string(s), 2, dims, settings[s].second)->write(data.data(), 2, dims);
+		file.close();
+	}
+	HDF5File file(TEST_FILE, true);
+	const long raw = (long)(rows*cols*sizeof(double));
+	// 32x256 chunks, fletcher32 adds 4 bytes to each of them
+	const long checksums = 4 * (rows/32) * (cols/256);
+	for(size_t s=0;s<settings.size();s++) {
+		HDF5Dataset* ds = file.dataset("d" + std::to_string(s));
+		const HDF5DatasetOptions &options = settings[s].second;
+		std::vector<double> back(rows*cols);
+		ds->read(back.data(), 2, dims);
+		if(back != data) {
+			cerr << "Round trip with " << settings[s].first << " changes the data" << endl;
+			exit(EXIT_FAILURE);
+		}
+		const long storage = ds->getStorageSize();
+		const long expected = raw + (options.fletcher32 ? checksums : 0);
+		if((options.deflate >= 0 && storage >= raw/2) || (options.deflate < 0 && storage != expected)) {
+			cerr << "Dataset with " << settings[s].first << " has a storage size of " << storage << " bytes" << endl;
+			exit(EXIT_FAILURE);
+		}
+		delete ds;
+	}
+	file.close();
+
+	// Illegal deflate levels and mandatory filters that are not available fail on creation
+	HDF5File out(TEST_FILE);
+	try {
+		out.createDataset("level", 2, dims, HDF5DatasetOptions().compressed(10));
+		cerr << "Deflate level 10 did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	// 32000 is the registered identifier of LZF, which is not built into the library
+	const H5Z_filter_t lzf = 32000;
+	if(H5Zfilter_avail(lzf) <= 0) {
+		try {
+			out.createDataset("lzf", 2, dims, HDF5DatasetOptions().filter(lzf));
+			cerr << "Mandatory filter that is not available did not throw" << endl;
+			exit(EXIT_FAILURE);
+		} catch (HDF5Exception &e) {}
+		out.createDataset("lzf", 2, dims, HDF5DatasetOptions().filter(lzf, std::vector<unsigned int>(), H5Z_FLAG_OPTIONAL))->write(data.data(), 2, dims);
+		std::vector<double> back(rows*cols);
+		out.dataset("lzf")->read(back.data(), 2, dims);
+		if(back != data) {
+			cerr << "Optional filter that is not available changes the data" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	out.close();
+	remove(TEST_FILE);
+}
+
+
+static double tesseract_value(const size_t i, const size_t j, const size_t k, const size_t l) {
+	return (double)(i*1000000 + j*10000 + k*100 + l);
+}
+
+static void test_write_containers() {
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+
+	// m(x,y) is stored at [y][x]
+	numeric::Matrix<float> m(5, 3);
+	for(size_t x=0;x<5;x++)
+		for(size_t y=0;y<3;y++) m(x,y) = (float)(10*x + y);
+	size_t mdims[2] = {3, 5};
+	HDF5Dataset* ds = file.createDataset<float>("matrix", 2, mdims);
+	ds->write(m);
+	std::vector<float> mback(15);
+	ds->read(mback.data(), 2, mdims);
+	for(size_t x=0;x<5;x++)
+		for(size_t y=0;y<3;y++)
+			if(mback[y*5+x] != m(x,y)) {
+				cerr << "Matrix write error at " << x << "," << y << endl;
+				exit(EXIT_FAILURE);
+			}
+	try {
+		ds->write(numeric::Matrix<float>(3, 5));
+		cerr << "Writing a transposed matrix did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+
+	// Several slabs along both of the first two dimensions: 32 cells along the first and 32 along
+	// the second (4 MiB) per slab, with a partial slab at the end of each
+	const size_t n0 = 40, n1 = 100, n2 = 32, n3 = 16;
+	numeric::Tesseract<double> t(n0, n1, n2, n3);
+	for(numeric::Tesseract<double>::index_iterator it = t.ibegin(); it != t.iend(); ++it)
+		*it = tesseract_value(it[0], it[1], it[2], it[3]);
+	size_t tdims[4] = {n0, n1, n2, n3};
+	ds = file.createDataset("tesseract", 4, tdims);
+	ds->write(t);
+	std::vector<double> tback(t.size());
+	ds->read(tback.data(), 4, tdims);
+	for(size_t i=0;i<n0;i++)
+		for(size_t j=0;j<n1;j++)
+			for(size_t k=0;k<n2;k++)
+				for(size_t l=0;l<n3;l++)
+					if(tback[((i*n1 + j)*n2 + k)*n3 + l] != tesseract_value(i,j,k,l)) {
+						cerr << "Tesseract write error at " << i << "," << j << "," << k << "," << l << endl;
+						exit(EXIT_FAILURE);
+					}
+	try {
+		ds->write(numeric::Tesseract<double>(n0, n1, n2, n3-1));
+		cerr << "Writing a tesseract of the wrong size did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+
+	std::valarray<int32_t> v(1000);
+	for(size_t i=0;i<v.size();i++) v[i] = (int32_t)(i*i) - 5000;
+	size_t vdims[1] = {v.size()};
+	ds = file.createDataset<int32_t>("valarray", 1, vdims);
+	ds->write(v);
+	std::vector<int32_t> vback(v.size());
+	ds->read(vback.data(), 1, vdims);
+	for(size_t i=0;i<v.size();i++)
+		if(vback[i] != v[i]) {
+			cerr << "valarray write error at " << i << endl;
+			exit(EXIT_FAILURE);
+		}
+	try {
+		ds->write(std::valarray<int32_t>(999));
+		cerr << "Writing a valarray of the wrong size did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	try {
+		ds->write(m);
+		cerr << "Writing a matrix to a 1d dataset did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+static void test_memspace_cache() {
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	const size_t n = 64;
+	std::vector<double> data(n*n);
+	for(size_t i=0;i<data.size();i++) data[i] = (double)i;
+	size_t dims[2] = {n, n};
+	HDF5Dataset* ds = file.createDataset("d", 2, dims);
+	ds->write(data.data(), 2, dims);
+
+	// 12 region shapes, more than the dataspaces cached per dataset, visited forwards and backwards
+	// so that shapes are found in the cache, evicted and created again. Writes negate the region
+	const size_t shapes = 12;
+	std::vector<double> buf(n*n);
+	for(size_t round=0;round<4;round++) {
+		for(size_t s=0;s<shapes;s++) {
+			const size_t shape = (round % 2 == 0) ? s : shapes-1-s;
+			const size_t count[2] = {shape+1, 13-shape};
+			const size_t offset[2] = {(round*7 + shape*3) % (n-count[0]), (round*5 + shape) % (n-count[1])};
+			ds->readRegion(buf.data(), 2, offset, count);
+			for(size_t y=0;y<count[0];y++)
+				for(size_t x=0;x<count[1];x++) {
+					const size_t idx = (offset[0]+y)*n + offset[1]+x;
+					if(buf[y*count[1]+x] != data[idx]) {
+						cerr << "Region of shape " << count[0] << "x" << count[1] << " read error in round " << round << endl;
+						exit(EXIT_FAILURE);
+					}
+					buf[y*count[1]+x] = data[idx] = -data[idx];
+				}
+			ds->writeRegion(buf.data(), 2, offset, count);
+		}
+	}
+	std::vector<double> back(n*n);
+	ds->read(back.data(), 2, dims);
+	if(back != data) {
+		cerr << "Region writes with more shapes than cached dataspaces changed other cells" << endl;
+		exit(EXIT_FAILURE);
+	}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+static uint8_t point_value(const size_t i, const size_t j, const size_t k) {
+	return (uint8_t)((i*31 + j*7 + k) % 251);
+}
+
+static void test_read_points() {
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	const size_t n0 = 7, n1 = 11, n2 = 13;
+	std::vector<uint8_t> data(n0*n1*n2);
+	for(size_t i=0;i<n0;i++)
+		for(size_t j=0;j<n1;j++)
+			for(size_t k=0;k<n2;k++) data[(i*n1 + j)*n2 + k] = point_value(i,j,k);
+	size_t dims[3] = {n0, n1, n2};
+	HDF5Dataset* ds = file.createDataset<uint8_t>("bytes", 3, dims);
+	ds->write(data.data(), 3, dims);
+
+	// Unsorted points with duplicates, read with a one byte memory type and as double, which
+	// scatters elements of a different size back to the requested order
+	const size_t count = 200;
+	std::vector<size_t> coords(3*count);
+	srand(11);
+	for(size_t p=0;p<count;p++) {
+		if(p % 10 == 9) {
+			// Duplicate of an earlier point
+			const size_t q = rand() % p;
+			for(int d=0;d<3;d++) coords[3*p+d] = coords[3*q+d];
+		} else {
+			coords[3*p] = rand() % n0;
+			coords[3*p+1] = rand() % n1;
+			coords[3*p+2] = rand() % n2;
+		}
+	}
+	std::vector<uint8_t> bytes(count, 0);
+	std::vector<double> values(count, -1.0);
+	if(ds->readPoints(bytes.data(), coords.data(), count) != count || ds->readPoints(values.data(), coords.data(), count) != count) {
+		cerr << "Point read returns the wrong count" << endl;
+		exit(EXIT_FAILURE);
+	}
+	for(size_t p=0;p<count;p++) {
+		const uint8_t expected = point_value(coords[3*p], coords[3*p+1], coords[3*p+2]);
+		if(bytes[p] != expected || values[p] != (double)expected) {
+			cerr << "Point read error at point " << p << ": " << (int)bytes[p] << ", " << values[p] << " != " << (int)expected << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	// A single point
+	uint8_t single = 0;
+	ds->readPoints(&single, &coords[3*(count-1)], 1);
+	if(single != bytes[count-1]) {
+		cerr << "Single point read error" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Points outside of the dataset throw and leave the dataset usable
+	coords[3*50+1] = n1;
+	try {
+		ds->readPoints(bytes.data(), coords.data(), count);
+		cerr << "Point outside of the dataset did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	coords[3*50+1] = 0;
+	ds->readPoints(bytes.data(), coords.data(), count);
+	if(bytes[50] != point_value(coords[150], 0, coords[152]) || bytes[count-1] != single) {
+		cerr << "Point read error after a point outside of the dataset" << endl;
+		exit(EXIT_FAILURE);
+	}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+/** Round trip of values of type T at both ends of its range, stored as NativeType<T> */
+template <class T>
+static void test_typed(const std::string &name) {
+	const T lo = std::numeric_limits<T>::lowest(), hi = std::numeric_limits<T>::max();
+	const size_t n0 = 6, n1 = 9;
+	std::vector<T> data(n0*n1);
+	for(size_t i=0;i<data.size();i++) data[i] = (i % 2 == 0) ? (T)(lo + (T)i) : (T)(hi - (T)i);
+	size_t dims[2] = {n0, n1};
+	{
+		HDF5File file(TEST_FILE);
+		file.createDataset<T>(name, 2, dims)->write(data.data(), 2, dims);
+		file.close();
+	}
+	HDF5File file(TEST_FILE, true);
+	HDF5Dataset* ds = file.dataset(name);
+	if(ds->typeSize() != sizeof(T) || ds->isFloat() != std::is_floating_point<T>::value || ds->isInteger() != std::is_integral<T>::value) {
+		cerr << "Dataset " << name << " is not stored as its native type" << endl;
+		exit(EXIT_FAILURE);
+	}
+	std::vector<T> back(data.size());
+	ds->read(back.data(), 2, dims);
+	if(back != data) {
+		cerr << "Typed round trip of " << name << " changes the data" << endl;
+		exit(EXIT_FAILURE);
+	}
+	file.close();
+}
+
+static void test_typed_datasets() {
+	remove(TEST_FILE);
+	// Every dataset is checked in the file after it was reopened
+	test_typed<float>("float");
+	test_typed<int32_t>("int32");
+	test_typed<int64_t>("int64");
+	test_typed<uint8_t>("uint8");
+	test_typed<double>("double");
+
+	// Reading converts to the requested type. 2^62 + 1 cannot be represented as double
+	HDF5File file(TEST_FILE);
+	size_t dims[1] = {2};
+	const int64_t big[2] = {((int64_t)1 << 62) + 1, -3};
+	file.createDataset<int64_t>("big", 1, dims)->write(big, 2);
+	HDF5Dataset* ds = file.dataset("big");
+	int64_t ints[2];
+	double doubles[2];
+	uint8_t bytes[2];
+	ds->read(ints, 1, dims);
+	ds->read(doubles, 1, dims);
+	const size_t offset[2] = {0, 0}, count[2] = {1, 2};
+	file.dataset("uint8")->readRegion(bytes, 2, offset, count);
+	if(ints[0] != big[0] || doubles[0] != (double)((int64_t)1 << 62) || doubles[1] != -3.0 || bytes[0] != 0 || bytes[1] != 254) {
+		cerr << "Typed read conversion error" << endl;
+		exit(EXIT_FAILURE);
+	}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+static size_t chunk_bytes(const std::vector<size_t> &chunk, const size_t typeSize) {
+	size_t bytes = typeSize;
+	for(size_t i=0;i<chunk.size();i++) bytes *= chunk[i];
+	return bytes;
+}
+
+static void test_chunk_shape() {
+	// Halving the longest dimension ends between half the target and the target
+	const size_t target = HDF5DatasetOptions::DEFAULT_CHUNK_BYTES;
+	const size_t dims[3] = {100, 200, 300};
+	std::vector<size_t> chunk = HDF5DatasetOptions::chunkShape(3, dims, 8);
+	if(chunk.size() != 3 || chunk_bytes(chunk, 8) > target || chunk_bytes(chunk, 8) <= target/2 || chunk[0] > dims[0] || chunk[1] > dims[1] || chunk[2] > dims[2]) {
+		cerr << "Chunk shape " << chunk[0] << "x" << chunk[1] << "x" << chunk[2] << " does not fit the target size" << endl;
+		exit(EXIT_FAILURE);
+	}
+	// Ties halve the slowest-varying dimension first
+	const size_t square[2] = {1024, 1024};
+	chunk = HDF5DatasetOptions::chunkShape(2, square, 4, 1024*1024);
+	if(chunk[0] != 512 || chunk[1] != 512) {
+		cerr << "Chunk shape of a square dataset is " << chunk[0] << "x" << chunk[1] << endl;
+		exit(EXIT_FAILURE);
+	}
+	// Small datasets are a single chunk, elements larger than the target a single element
+	const size_t small[2] = {3, 0};
+	chunk = HDF5DatasetOptions::chunkShape(2, small, 8);
+	if(chunk[0] != 3 || chunk[1] != 1 || HDF5DatasetOptions::chunkShape(3, dims, 64, 16) != std::vector<size_t>(3, 1)) {
+		cerr << "Chunk shape of small datasets error" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	// The unlimited dimension takes whatever is left of the target by the fixed ones
+	size_t rows[2] = {0, 1000};
+	HDF5Dataset* ds = file.createDataset("unlimited", 2, rows, HDF5DatasetOptions().unlimited());
+	chunk = ds->chunk();
+	if(chunk.size() != 2 || chunk[1] != 1000 || chunk[0] != target/(1000*sizeof(double))) {
+		cerr << "Chunk of an unlimited dataset is " << chunk[0] << "x" << chunk[1] << endl;
+		exit(EXIT_FAILURE);
+	}
+	// Automatic chunks are bounded by the maximum, not the current dimensions
+	size_t grow[2] = {10, 10};
+	HDF5DatasetOptions bounded;
+	bounded.maxDims = std::vector<size_t>{1000};
+	ds = file.createDataset("bounded", 2, grow, bounded.chunked());
+	if(ds->chunk() != std::vector<size_t>{1000, 10}) {
+		cerr << "Chunk of a bounded dataset is " << ds->chunk()[0] << "x" << ds->chunk()[1] << endl;
+		exit(EXIT_FAILURE);
+	}
+	// Explicit chunks are read back unchanged, contiguous datasets have none
+	ds = file.createDataset<float>("explicit", 2, grow, HDF5DatasetOptions().chunked(std::vector<size_t>{7, 3}));
+	if(ds->chunk() != std::vector<size_t>{7, 3} || !file.createDataset("contiguous", 2, grow)->chunk().empty()) {
+		cerr << "Chunk read back error" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// A chunk larger than the maximum dimension and maximum dimensions of a higher rank throw
+	bounded.chunked(std::vector<size_t>{1001, 10});
+	try {
+		file.createDataset("large", 2, grow, bounded);
+		cerr << "Chunk larger than the maximum dimension did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	HDF5DatasetOptions rank;
+	rank.maxDims = std::vector<size_t>{0, 0, 0};
+	try {
+		file.createDataset("rank", 2, grow, rank.chunked());
+		cerr << "Maximum dimensions of a higher rank did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+static void test_read_containers() {
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	// Matrix: m(x,y) is the value at [y][x]
+	const size_t rows = 3, cols = 5;
+	std::vector<int32_t> mdata(rows*cols);
+	for(size_t i=0;i<mdata.size();i++) mdata[i] = (int32_t)(i*i) - 7;
+	size_t mdims[2] = {rows, cols};
+	HDF5Dataset* ds = file.createDataset<int32_t>("matrix", 2, mdims);
+	ds->write(mdata.data(), 2, mdims);
+	// Transposed and then matching size. The second read must not reallocate
+	numeric::Matrix<int32_t> m(rows, cols);
+	for(int pass=0;pass<2;pass++) {
+		const int32_t* storage = m.data();
+		ds->read(m);
+		if(m.size(0) != cols || m.size(1) != rows || (pass == 1 && m.data() != storage)) {
+			cerr << "Matrix read has size " << m.size(0) << "x" << m.size(1) << " in pass " << pass << endl;
+			exit(EXIT_FAILURE);
+		}
+		for(size_t x=0;x<cols;x++)
+			for(size_t y=0;y<rows;y++)
+				if(m(x,y) != mdata[y*cols+x]) {
+					cerr << "Matrix read error at " << x << "," << y << " in pass " << pass << endl;
+					exit(EXIT_FAILURE);
+				}
+	}
+
+	// Tesseract: t(i,j,k,l) is the value at [i][j][k][l]
+	const size_t n0 = 3, n1 = 4, n2 = 5, n3 = 6;
+	std::vector<double> tdata(n0*n1*n2*n3);
+	for(size_t i=0;i<n0;i++)
+		for(size_t j=0;j<n1;j++)
+			for(size_t k=0;k<n2;k++)
+				for(size_t l=0;l<n3;l++) tdata[((i*n1 + j)*n2 + k)*n3 + l] = tesseract_value(i,j,k,l);
+	size_t tdims[4] = {n0, n1, n2, n3};
+	ds = file.createDataset("tesseract", 4, tdims);
+	ds->write(tdata.data(), 4, tdims);
+	numeric::Tesseract<double> t(n3, n2, n1, n0);
+	for(int pass=0;pass<2;pass++) {
+		const double* storage = t.data();
+		ds->read(t);
+		if(t.size(0) != n0 || t.size(1) != n1 || t.size(2) != n2 || t.size(3) != n3 || (pass == 1 && t.data() != storage)) {
+			cerr << "Tesseract read has the wrong size in pass " << pass << endl;
+			exit(EXIT_FAILURE);
+		}
+		for(numeric::Tesseract<double>::index_iterator it = t.ibegin(); it != t.iend(); ++it)
+			if(*it != tesseract_value(it[0], it[1], it[2], it[3])) {
+				cerr << "Tesseract read error at " << it[0] << "," << it[1] << "," << it[2] << "," << it[3] << " in pass " << pass << endl;
+				exit(EXIT_FAILURE);
+			}
+	}
+
+	// Containers of the wrong rank
+	try {
+		file.dataset("matrix")->read(t);
+		cerr << "Reading a 2d dataset into a tesseract did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	try {
+		file.dataset("tesseract")->read(m);
+		cerr << "Reading a 4d dataset into a matrix did not throw" << endl;
+		exit(EXIT_FAILURE);
+	} catch (HDF5Exception &e) {}
+	file.close();
+	remove(TEST_FILE);
+}
+
+
+/* ==== Benchmarks ========================================================== */
+
+static double wtime() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void bench_filters() {
+	const size_t rows = 4096, cols = 1024;
+	std::vector<double> data, back(rows*cols);
+	filter_data(data, rows, cols);
+	const double mb = rows*cols*sizeof(double) / 1e6;
+	size_t dims[2] = {rows, cols};
+	const std::vector<std::pair<std::string, HDF5DatasetOptions> > settings = filter_settings();
+	for(size_t s=0;s<settings.size();s++) {
+		remove(TEST_FILE);
+		HDF5File file(TEST_FILE);
+		double t0 = wtime();
+		HDF5Dataset* ds = file.createDataset("d", 2, dims, settings[s].second);
+		ds->write(data.data(), 2, dims);
+		file.close();
+		const double twrite = wtime() - t0;
+		HDF5File in(TEST_FILE, true);
+		t0 = wtime();
+		ds = in.dataset("d");
+		ds->read(back.data(), 2, dims);
+		const double tread = wtime() - t0;
+		const double ratio = rows*cols*sizeof(double) / (double)ds->getStorageSize();
+		delete ds;
+		in.close();
+		cout << "filters " << settings[s].first << ": write " << mb/twrite << " MB/s, read " << mb/tread << " MB/s, ratio " << ratio << endl;
+	}
+	remove(TEST_FILE);
+}
+
+/** Peak resident set size of the process in MB */
+static double peak_rss() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+}
+
+static void bench_tesseract() {
+	// 134 MB. Writing and reading go through a slab buffer of 4 MiB, not a copy of the data
+	const size_t n0 = 64, n1 = 128, n2 = 64, n3 = 32;
+	numeric::Tesseract<double> t(n0, n1, n2, n3);
+	for(numeric::Tesseract<double>::index_iterator it = t.ibegin(); it != t.iend(); ++it)
+		*it = tesseract_value(it[0], it[1], it[2], it[3]);
+	const double mb = t.size()*sizeof(double) / 1e6;
+	size_t dims[4] = {n0, n1, n2, n3};
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	HDF5Dataset* ds = file.createDataset("tesseract", 4, dims);
+	double rss = peak_rss();
+	double t0 = wtime();
+	ds->write(t);
+	const double twrite = wtime() - t0;
+	const double wrss = peak_rss() - rss;
+	rss = peak_rss();
+	t0 = wtime();
+	ds->read(t);
+	const double tread = wtime() - t0;
+	const double rrss = peak_rss() - rss;
+	file.close();
+	remove(TEST_FILE);
+	cout << "tesseract " << n0 << "x" << n1 << "x" << n2 << "x" << n3 << " (" << mb << " MB): write " << mb/twrite << " MB/s, peak RSS +" << wrss
+		<< " MB, read " << mb/tread << " MB/s, peak RSS +" << rrss << " MB" << endl;
+}
+
+static void bench_small_reads() {
+	const size_t n = 256;
+	std::vector<double> data(n*n);
+	for(size_t i=0;i<data.size();i++) data[i] = (double)i;
+	size_t dims[2] = {n, n};
+	remove(TEST_FILE);
+	HDF5File file(TEST_FILE);
+	HDF5Dataset* ds = file.createDataset("d", 2, dims);
+	ds->write(data.data(), 2, dims);
+	// Up to 8 shapes hit the cached memory dataspaces, 12 shapes miss on every read
+	const size_t shapes[] = {1, 8, 12};
+	const size_t reads = 200000;
+	double buf[16*16];
+	for(size_t s=0;s<sizeof(shapes)/sizeof(size_t);s++) {
+		double sum = 0;
+		const double t0 = wtime();
+		for(size_t r=0;r<reads;r++) {
+			const size_t shape = r % shapes[s];
+			const size_t count[2] = {1 + shape, 16 - shape};
+			const size_t offset[2] = {(r*17) % (n-16), (r*31) % (n-16)};
+			ds->readRegion(buf, 2, offset, count);
+			sum += buf[0];
+		}
+		const double t = wtime() - t0;
+		cout << "small reads, " << shapes[s] << " region shapes: " << t/reads*1e6 << " us per read (checksum " << sum << ")" << endl;
+	}
+	file.close();
+	remove(TEST_FILE);
+}
+
+static void bench() {
+	bench_filters();
+	bench_tesseract();
+	bench_small_reads();
+}
+
+
+int main(int argc, char** argv) {
+	if(argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench();
+		return EXIT_SUCCESS;
+	}
+
+	test_append_limited();
+	test_append_second_holder();
+	test_region_cube();
+	test_handle_cache();
+	test_level_set();
+	test_filters();
+	test_write_containers();
+	test_memspace_cache();
+	test_read_points();
+	test_typed_datasets();
+	test_chunk_shape();
+	test_read_containers();
+
+	cout << "All good" << endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+/* =============================================================================
+ *
+ * Title:       Summed-area tables
+ * Author:      Felix Niederwanger
+ * License:     MIT (http://opensource.org/licenses/MIT)
+ * Description: Integral images of Matrix and integral volumes of Cube data,
+ *              answering sums over axis-aligned boxes in constant time.
+ *              Standalone header file
+ * =============================================================================
+ */
+
+#ifndef _NUMERIC_INTEGRAL_HPP_
+#define _NUMERIC_INTEGRAL_HPP_
+
+#include "numeric.hpp"
+
+namespace numeric {
+
+/** Axis-aligned box with inclusive lower and exclusive upper bounds */
+template <int N>
+struct Box {
+	size_t lo[N];
+	size_t hi[N];
+};
+
+/**
+ * Prefix sums over the rows of a (width x rows) array: row[i] += row[i-1]. Threads
+ * work on separate column blocks, the inner loop is vectorized over the columns
+ */
+template <class S>
+void scanBlocks(S* data, const size_t width, const size_t rows) {
+	const size_t block = 1024;
+	const size_t blocks = (width + block - 1) / block;
+	#pragma omp parallel for schedule(static)
+	for(long b=0;b<(long)blocks;b++) {
+		const size_t x0 = b*block;
+		const size_t x1 = (x0 + block < width) ? x0 + block : width;
+		for(size_t r=1;r<rows;r++) {
+			S* row = data + r*width;
+			const S* prev = row - width;
+			#pragma omp simd
+			for(size_t x=x0;x<x1;x++) row[x] += prev[x];
+		}
+	}
+}
+
+/**
+ * Summed-area table of a Matrix. Sums are accumulated in S, which defaults to double
+ * so that float and integer data do not lose precision in large tables. The table has
+ * a leading row and column of zeros, so queries need no bounds checks
+ */
+template <class S = double>
+class IntegralImage {
+protected:
+	size_t nx, ny;
+	Matrix<S> table;
+
+	S at(const size_t x, const size_t y) const { return this->table(x, y); }
+
+public:
+	template <class T>
+	IntegralImage(const Matrix<T> &m) : nx(m.size(0)), ny(m.size(1)), table(m.size(0)+1, m.size(1)+1) {
+		const size_t w = this->nx+1;
+		S* t = this->table.data();
+		for(size_t x=0;x<w;x++) t[x] = S(0);
+		// Prefix sums along x for every row, then along y for every column
+		#pragma omp parallel for schedule(static)
+		for(long y=0;y<(long)this->ny;y++) {
+			S* row = t + (y+1)*w;
+			const T* src = m.data() + y*this->nx;
+			S sum = 0;
+			row[0] = S(0);
+			for(size_t x=0;x<this->nx;x++) {
+				sum += S(src[x]);
+				row[x+1] = sum;
+			}
+		}
+		scanBlocks(t, w, this->ny+1);
+	}
+
+	size_t size(const size_t i) const { return (i == 0) ? this->nx : this->ny; }
+
+	/** Sum over [x0,x1) x [y0,y1) */
+	S sum(const size_t x0, const size_t y0, const size_t x1, const size_t y1) const {
+		if(x1 <= x0 || y1 <= y0) return S(0);
+		return this->at(x1,y1) - this->at(x0,y1) - this->at(x1,y0) + this->at(x0,y0);
+	}
+	S sum(const Box<2> &b) const { return this->sum(b.lo[0], b.lo[1], b.hi[0], b.hi[1]); }
+
+	/** Average over [x0,x1) x [y0,y1) */
+	S avg(const size_t x0, const size_t y0, const size_t x1, const size_t y1) const {
+		if(x1 <= x0 || y1 <= y0) return S(0);
+		return this->sum(x0,y0,x1,y1) / S((x1-x0)*(y1-y0));
+	}
+
+	/** Sums over n boxes, evaluated in parallel */
+	void sum(const Box<2>* boxes, S* out, const size_t n) const {
+		#pragma omp parallel for schedule(static)
+		for(long i=0;i<(long)n;i++) out[i] = this->sum(boxes[i]);
+	}
+};
+
+/**
+ * Summed-volume table of a Cube, the three-dimensional counterpart of IntegralImage.
+ * The table is built by a prefix scan along each axis, parallel over independent lines
+ */
+template <class S = double>
+class IntegralVolume {
+protected:
+	size_t n[3];
+	Cube<S> table;
+
+	S at(const size_t x, const size_t y, const size_t z) const { return this->table(x, y, z); }
+
+public:
+	template <class T>
+	IntegralVolume(const Cube<T> &c) : table(c.size(0)+1, c.size(1)+1, c.size(2)+1) {
+		for(int d=0;d<3;d++) this->n[d] = c.size(d);
+		const size_t w = this->n[0]+1, plane = w*(this->n[1]+1);
+		S* t = this->table.data();
+		for(size_t i=0;i<plane;i++) t[i] = S(0);
+		// Prefix sums along x, with zero padding at x = 0 and y = 0
+		#pragma omp parallel for schedule(static)
+		for(long z=0;z<(long)this->n[2];z++) {
+			S* p = t + (z+1)*plane;
+			for(size_t x=0;x<w;x++) p[x] = S(0);
+			for(size_t y=0;y<this->n[1];y++) {
+				S* row = p + (y+1)*w;
+				const T* src = c.data() + (z*this->n[1] + y)*this->n[0];
+				S sum = 0;
+				row[0] = S(0);
+				for(size_t x=0;x<this->n[0];x++) {
+					sum += S(src[x]);
+					row[x+1] = sum;
+				}
+			}
+		}
+		// Along y within each plane, vectorized over x
+		#pragma omp parallel for schedule(static)
+		for(long z=1;z<=(long)this->n[2];z++) {
+			S* p = t + z*plane;
+			for(size_t y=1;y<=this->n[1];y++) {
+				S* row = p + y*w;
+				const S* prev = row - w;
+				#pragma omp simd
+				for(size_t x=0;x<w;x++) row[x] += prev[x];
+			}
+		}
+		// Along z, parallel over blocks of cells of a plane
+		scanBlocks(t, plane, this->n[2]+1);
+	}
+
+	size_t size(const size_t i) const { return this->n[i]; }
+
+	/** Sum over [x0,x1) x [y0,y1) x [z0,z1) */
+	S sum(const size_t x0, const size_t y0, const size_t z0, const size_t x1, const size_t y1, const size_t z1) const {
+		if(x1 <= x0 || y1 <= y0 || z1 <= z0) return S(0);
+		return this->at(x1,y1,z1) - this->at(x0,y1,z1) - this->at(x1,y0,z1) - this->at(x1,y1,z0)
+			+ this->at(x0,y0,z1) + this->at(x0,y1,z0) + this->at(x1,y0,z0) - this->at(x0,y0,z0);
+	}
+	S sum(const Box<3> &b) const { return this->sum(b.lo[0], b.lo[1], b.lo[2], b.hi[0], b.hi[1], b.hi[2]); }
+
+	/** Average over [x0,x1) x [y0,y1) x [z0,z1) */
+	S avg(const size_t x0, const size_t y0, const size_t z0, const size_t x1, const size_t y1, const size_t z1) const {
+		if(x1 <= x0 || y1 <= y0 || z1 <= z0) return S(0);
+		return this->sum(x0,y0,z0,x1,y1,z1) / S((x1-x0)*(y1-y0)*(z1-z0));
+	}
+
+	/** Sums over n boxes, evaluated in parallel */
+	void sum(const Box<3>* boxes, S* out, const size_t n) const {
+		#pragma omp parallel for schedule(static)
+		for(long i=0;i<(long)n;i++) out[i] = this->sum(boxes[i]);
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,419 @@
+/* =============================================================================
+ *
+ * Title:       Geometric multigrid Poisson solver
+ * Author:      Felix Niederwanger
+ * License:     MIT (http://opensource.org/licenses/MIT)
+ * Description: Solves the Poisson equation lap(phi) = f on a Cube with V- or
+ *              W-cycles, red-black Gauss-Seidel smoothing and periodic or
+ *              (homogeneous) Dirichlet boundaries. Values are cell-centered,
+ *              Dirichlet boundaries are at the outer cell faces.
+ *              Standalone header file
+ * =============================================================================
+ */
+
+#ifndef _NUMERIC_MULTIGRID_HPP_
+#define _NUMERIC_MULTIGRID_HPP_
+
+#include <math.h>
+
+#include <vector>
+
+#include "numeric.hpp"
+
+namespace numeric {
+
+/** Boundary conditions of the Poisson solver */
+enum Boundary {
+	BOUNDARY_PERIODIC = 0,
+	/** phi = 0 at the outer cell faces */
+	BOUNDARY_DIRICHLET = 1
+};
+
+template <class T>
+class Multigrid {
+protected:
+	/** One level of the grid hierarchy */
+	struct Level {
+		size_t n[3];
+		T ih2[3];
+		Cube<T> phi, f, r;
+	};
+
+	std::vector<Level> levels;
+	Boundary boundary;
+	int gamma;
+	int preSmooth, postSmooth;
+	/** Conjugate gradient iterations of the coarsest level: relative residual reduction and iteration limit */
+	T coarseTolerance;
+	int coarseIterations;
+	/** Search direction and its image under the Laplacian on the coarsest level */
+	Cube<T> cgDir, cgLap;
+	T lastResidual;
+
+	/** Index of the neighbour of i in a dimension of size n, or -1 if outside of a Dirichlet boundary */
+	long neighbour(const long i, const long n) const {
+		if(i >= 0 && i < n) return i;
+		if(this->boundary == BOUNDARY_PERIODIC) return (i < 0) ? i+n : i-n;
+		return -1;
+	}
+
+	/**
+	 * Apply the discrete Laplacian to cell (i,j,k), split into the part of the neighbours
+	 * and the diagonal coefficient: lap(phi) = nb - diag*phi(i,j,k). Dirichlet ghost cells
+	 * are reflected (phi_ghost = -phi), which adds to the diagonal
+	 */
+	void stencil(const Level &l, const Cube<T> &phi, const size_t i, const size_t j, const size_t k, T &nb, T &diag) const {
+		const long idx[3] = {(long)i, (long)j, (long)k};
+		nb = 0;
+		diag = 0;
+		for(int d=0;d<3;d++) {
+			diag += 2*l.ih2[d];
+			for(int s=-1;s<=1;s+=2) {
+				long c[3] = {idx[0], idx[1], idx[2]};
+				c[d] = this->neighbour(idx[d]+s, (long)l.n[d]);
+				if(c[d] < 0) diag += l.ih2[d];
+				else nb += l.ih2[d] * phi(c[0], c[1], c[2]);
+			}
+		}
+	}
+
+	/** Neighbour rows in y and z of row (j,k). Rows outside of a Dirichlet boundary get weight zero */
+	struct Rows {
+		const T* nb[4];
+		T w[4];
+		T diag;
+	};
+
+	Rows rows(const Level &l, const T* phi, const size_t j, const size_t k) const {
+		Rows r;
+		const long nj[4] = {this->neighbour((long)j-1, (long)l.n[1]), this->neighbour((long)j+1, (long)l.n[1]), (long)j, (long)j};
+		const long nk[4] = {(long)k, (long)k, this->neighbour((long)k-1, (long)l.n[2]), this->neighbour((long)k+1, (long)l.n[2])};
+		r.diag = 2*(l.ih2[0] + l.ih2[1] + l.ih2[2]);
+		for(int s=0;s<4;s++) {
+			const T ih2 = l.ih2[1 + s/2];
+			if(nj[s] < 0 || nk[s] < 0) {
+				r.nb[s] = phi + (k*l.n[1] + j)*l.n[0];
+				r.w[s] = 0;
+				r.diag += ih2;
+			} else {
+				r.nb[s] = phi + (nk[s]*l.n[1] + nj[s])*l.n[0];
+				r.w[s] = ih2;
+			}
+		}
+		return r;
+	}
+
+	/** Red-black Gauss-Seidel update of the cells of one colour in plane k */
+	void smoothPlane(Level &l, const size_t color, const size_t k) {
+		const size_t nx = l.n[0];
+		const T ih2 = l.ih2[0];
+		const Cube<T> &phi = l.phi;
+		T* data = l.phi.data();
+		const T* rhs = l.f.data();
+		for(size_t j=0;j<l.n[1];j++) {
+			const size_t row = (k*l.n[1] + j)*nx;
+			T* p = data + row;
+			const T* f = rhs + row;
+			const Rows r = this->rows(l, data, j, k);
+			const T idiag = T(1)/r.diag;
+			const size_t first = (color+j+k)%2;
+			// Boundary cells in x use the general stencil, interior cells the row pointers
+			for(size_t i=first;i<nx;i+=2) {
+				if(i == 0 || i == nx-1) {
+					T nb, diag;
+					this->stencil(l, phi, i, j, k, nb, diag);
+					p[i] = (nb - f[i]) / diag;
+				} else
+					p[i] = (ih2*(p[i-1] + p[i+1]) + r.w[0]*r.nb[0][i] + r.w[1]*r.nb[1][i] + r.w[2]*r.nb[2][i] + r.w[3]*r.nb[3][i] - f[i]) * idiag;
+			}
+		}
+	}
+
+	/**
+	 * Red-black Gauss-Seidel sweeps. Cells of one colour are independent, planes run in parallel.
+	 * With an odd periodic extent in z, the last and the first plane are neighbours of the same
+	 * colour, so the last plane is updated after the others. Odd extents in x and y only couple
+	 * cells within a plane, which is updated by a single thread
+	 */
+	void smooth(Level &l, const int sweeps) {
+		const bool wrap = (this->boundary == BOUNDARY_PERIODIC && l.n[2] % 2 != 0);
+		const long planes = (long)l.n[2] - (wrap ? 1 : 0);
+		for(int sweep=0;sweep<sweeps;sweep++) {
+			for(size_t color=0;color<2;color++) {
+				#pragma omp parallel for schedule(static)
+				for(long k=0;k<planes;k++)
+					this->smoothPlane(l, color, (size_t)k);
+				if(wrap) this->smoothPlane(l, color, l.n[2]-1);
+			}
+		}
+	}
+
+	/** r = f - lap(phi) on the grid of level l, or r = -lap(phi) if rhs is NULL. Returns the maximum norm of r */
+	T residual(const Level &l, const Cube<T> &phi, const T* rhs, Cube<T> &out) const {
+		T norm = 0;
+		const size_t nx = l.n[0];
+		const T ih2 = l.ih2[0];
+		const T* data = phi.data();
+		T* res = out.data();
+		#pragma omp parallel for schedule(static) reduction(max:norm)
+		for(long k=0;k<(long)l.n[2];k++) {
+			for(size_t j=0;j<l.n[1];j++) {
+				const size_t row = (k*l.n[1] + j)*nx;
+				const T* p = data + row;
+				T* r = res + row;
+				const T* f = (rhs == NULL) ? NULL : rhs + row;
+				const Rows nb = this->rows(l, data, j, k);
+				for(size_t i=0;i<nx;i++) {
+					const T fi = (f == NULL) ? T(0) : f[i];
+					if(i == 0 || i == nx-1) {
+						T sum, diag;
+						this->stencil(l, phi, i, j, k, sum, diag);
+						r[i] = fi - (sum - diag*p[i]);
+					} else
+						r[i] = fi - (ih2*(p[i-1] + p[i+1]) + nb.w[0]*nb.nb[0][i] + nb.w[1]*nb.nb[1][i] + nb.w[2]*nb.nb[2][i] + nb.w[3]*nb.nb[3][i] - nb.diag*p[i]);
+					if(fabs(r[i]) > norm) norm = fabs(r[i]);
+				}
+			}
+		}
+		return norm;
+	}
+
+	/** r = f - lap(phi) on the given level, returns the maximum norm of r */
+	T residual(Level &l) { return this->residual(l, l.phi, l.f.data(), l.r); }
+
+	/** Scalar product of two cubes of level l. Planes are summed in order, so the result does not depend on the number of threads */
+	T dot(const Level &l, const Cube<T> &a, const Cube<T> &b) const {
+		const size_t plane = l.n[0]*l.n[1];
+		const T* pa = a.data();
+		const T* pb = b.data();
+		std::vector<T> partial(l.n[2]);
+		#pragma omp parallel for schedule(static)
+		for(long k=0;k<(long)l.n[2];k++) {
+			T sum = 0;
+			for(size_t i=k*plane;i<(k+1)*plane;i++) sum += pa[i]*pb[i];
+			partial[k] = sum;
+		}
+		T sum = 0;
+		for(size_t k=0;k<l.n[2];k++) sum += partial[k];
+		return sum;
+	}
+
+	/**
+	 * Solve the coarsest level with conjugate gradients on -lap, which is symmetric positive definite
+	 * (reflected Dirichlet ghost cells only add to the diagonal). For periodic boundaries the iterates
+	 * stay in the zero mean subspace. Iterates until the residual dropped by coarseTolerance, a few
+	 * smoothing sweeps would leave the smooth error of a large coarsest level untouched
+	 */
+	void coarseSolve(Level &l) {
+		const size_t size = l.phi.size();
+		T* x = l.phi.data();
+		T* r = l.r.data();
+		T* p = this->cgDir.data();
+		const T* q = this->cgLap.data();
+		this->residual(l);
+		if(this->boundary == BOUNDARY_PERIODIC) removeMean(l.r);
+		memcpy(p, r, size*sizeof(T));
+		T rr = this->dot(l, l.r, l.r);
+		const T target = rr * this->coarseTolerance * this->coarseTolerance;
+		int it = 0;
+		while(rr > target) {
+			if(it++ >= this->coarseIterations) throw "Coarsest multigrid level does not converge";
+			// q = -lap(p). With r = f - lap(x), the step along -p reduces r by alpha*q
+			this->residual(l, this->cgDir, NULL, this->cgLap);
+			const T pq = this->dot(l, this->cgDir, this->cgLap);
+			if(pq <= 0) break;
+			const T alpha = rr / pq;
+			#pragma omp parallel for schedule(static)
+			for(long i=0;i<(long)size;i++) {
+				x[i] -= alpha*p[i];
+				r[i] -= alpha*q[i];
+			}
+			const T rrNew = this->dot(l, l.r, l.r);
+			const T beta = rrNew / rr;
+			rr = rrNew;
+			#pragma omp parallel for schedule(static)
+			for(long i=0;i<(long)size;i++) p[i] = r[i] + beta*p[i];
+		}
+	}
+
+	/** Restrict the residual of level l to the right hand side of level l+1 by averaging 2x2x2 cells */
+	void restriction(const size_t l) {
+		const Level &fine = this->levels[l];
+		Level &coarse = this->levels[l+1];
+		const T* r = fine.r.data();
+		const size_t fx = fine.n[0], fxy = fine.n[0]*fine.n[1];
+		T* f = coarse.f.data();
+		#pragma omp parallel for schedule(static)
+		for(long k=0;k<(long)coarse.n[2];k++) {
+			for(size_t j=0;j<coarse.n[1];j++) {
+				const T* r0 = r + 2*k*fxy + 2*j*fx;
+				const T* r1 = r0 + fx;
+				const T* r2 = r0 + fxy;
+				const T* r3 = r2 + fx;
+				T* dst = f + (k*coarse.n[1] + j)*coarse.n[0];
+				for(size_t i=0;i<coarse.n[0];i++)
+					dst[i] = T(0.125) * (r0[2*i] + r0[2*i+1] + r1[2*i] + r1[2*i+1] + r2[2*i] + r2[2*i+1] + r3[2*i] + r3[2*i+1]);
+			}
+		}
+	}
+
+	/** Interpolation stencil of one fine cell along one axis: two coarse cells and their weights */
+	struct Interpolation {
+		size_t idx[2];
+		T w[2];
+	};
+
+	/** Interpolation stencils along axis d. Dirichlet ghost cells are reflected with a negative weight */
+	std::vector<Interpolation> interpolation(const Level &coarse, const int d) const {
+		const long n = (long)coarse.n[d];
+		std::vector<Interpolation> result(2*n);
+		for(long i=0;i<2*n;i++) {
+			const long I = i/2;
+			const long nb = this->neighbour(I + ((i%2 == 0) ? -1 : 1), n);
+			Interpolation &ip = result[i];
+			ip.idx[0] = I;
+			ip.w[0] = T(0.75);
+			ip.idx[1] = (nb < 0) ? I : nb;
+			ip.w[1] = (nb < 0) ? T(-0.25) : T(0.25);
+		}
+		return result;
+	}
+
+	/** Add the trilinearly interpolated correction of level l+1 to phi of level l */
+	void prolongate(const size_t l) {
+		Level &fine = this->levels[l];
+		const Level &coarse = this->levels[l+1];
+		const std::vector<Interpolation> ix = this->interpolation(coarse, 0), iy = this->interpolation(coarse, 1), iz = this->interpolation(coarse, 2);
+		const T* c = coarse.phi.data();
+		const size_t cx = coarse.n[0], cxy = coarse.n[0]*coarse.n[1];
+		T* phi = fine.phi.data();
+		#pragma omp parallel for schedule(static)
+		for(long k=0;k<(long)fine.n[2];k++) {
+			for(size_t j=0;j<fine.n[1];j++) {
+				T* p = phi + (k*fine.n[1] + j)*fine.n[0];
+				for(size_t i=0;i<fine.n[0];i++) {
+					T sum = 0;
+					for(int zc=0;zc<2;zc++)
+						for(int yc=0;yc<2;yc++) {
+							const T* row = c + iz[k].idx[zc]*cxy + iy[j].idx[yc]*cx;
+							const T w = iz[k].w[zc] * iy[j].w[yc];
+							sum += w * (ix[i].w[0]*row[ix[i].idx[0]] + ix[i].w[1]*row[ix[i].idx[1]]);
+						}
+					p[i] += sum;
+				}
+			}
+		}
+	}
+
+	/** Remove the mean, which is undetermined for periodic boundaries */
+	static void removeMean(Cube<T> &c) {
+		const T mean = c.avg();
+		for(size_t i=0;i<c.size();i++) c[i] -= mean;
+	}
+
+	void cycle(const size_t l) {
+		Level &level = this->levels[l];
+		if(l+1 == this->levels.size()) {
+			this->coarseSolve(level);
+			if(this->boundary == BOUNDARY_PERIODIC) removeMean(level.phi);
+			return;
+		}
+		this->smooth(level, this->preSmooth);
+		this->residual(level);
+		this->restriction(l);
+		this->levels[l+1].phi = T(0);
+		for(int g=0;g<this->gamma;g++) this->cycle(l+1);
+		this->prolongate(l);
+		this->smooth(level, this->postSmooth);
+	}
+
+public:
+	/**
+	 * Create a solver for a (nx x ny x nz) grid with the given cell sizes. The grid is
+	 * coarsened by two as long as all dimensions are even and at least 4, so the coarsest
+	 * level keeps the odd factor of the dimensions: 64^3 coarsens down to 2^3, 96^3 to 3^3,
+	 * but 65^3 is not coarsened at all. The coarsest level is solved by conjugate gradients,
+	 * whose iterations grow linearly with its extent. Cycles stay correct for any size, but
+	 * they only run at multigrid speed if the dimensions are a small number times a power of two
+	 */
+	Multigrid(const size_t nx, const size_t ny, const size_t nz, const T hx, const T hy, const T hz, const Boundary boundary = BOUNDARY_PERIODIC) :
+		boundary(boundary), gamma(1), preSmooth(2), postSmooth(2), coarseTolerance(T(1e-3)), coarseIterations(1000), lastResidual(0) {
+		size_t n[3] = {nx, ny, nz};
+		T h[3] = {hx, hy, hz};
+		while(true) {
+			Level l;
+			for(int d=0;d<3;d++) {
+				l.n[d] = n[d];
+				l.ih2[d] = T(1)/(h[d]*h[d]);
+			}
+			l.phi.resize(n[0], n[1], n[2]);
+			l.f.resize(n[0], n[1], n[2]);
+			l.r.resize(n[0], n[1], n[2]);
+			this->levels.push_back(l);
+			bool coarsen = true;
+			for(int d=0;d<3;d++)
+				if(n[d] % 2 != 0 || n[d] < 4) coarsen = false;
+			if(!coarsen) {
+				this->cgDir.resize(n[0], n[1], n[2]);
+				this->cgLap.resize(n[0], n[1], n[2]);
+				break;
+			}
+			for(int d=0;d<3;d++) {
+				n[d] /= 2;
+				h[d] *= 2;
+			}
+		}
+	}
+
+	/** Use V-cycles (gamma = 1, default) or W-cycles (gamma = 2) */
+	void setCycle(const int gamma) { this->gamma = (gamma > 0) ? gamma : 1; }
+	/** Set the number of pre- and post-smoothing sweeps */
+	void setSmoothing(const int pre, const int post) {
+		this->preSmooth = pre;
+		this->postSmooth = post;
+	}
+	/**
+	 * Set the residual reduction of the conjugate gradient solve on the coarsest level (default 1e-3)
+	 * and its iteration limit (default 1000). solve throws if the limit is reached, which means the
+	 * coarsest level is too large, see the constructor
+	 */
+	void setCoarseSolve(const T tolerance, const int maxIterations) {
+		this->coarseTolerance = tolerance;
+		this->coarseIterations = maxIterations;
+	}
+	/** Number of grid levels */
+	size_t depth() const { return this->levels.size(); }
+	/** Maximum norm of the residual after the last solve */
+	T residual() const { return this->lastResidual; }
+
+	/**
+	 * Solve lap(phi) = f. For periodic boundaries the mean of f is ignored and phi has zero mean
+	 * @param phi Initial guess and solution
+	 * @param tolerance Stop if the maximum residual is below tolerance times the maximum of |f|
+	 * @return number of cycles done
+	 */
+	int solve(Cube<T> &phi, const Cube<T> &f, const T tolerance = 1e-10, const int maxCycles = 100) {
+		Level &top = this->levels[0];
+		if(phi.size(0) != top.n[0] || phi.size(1) != top.n[1] || phi.size(2) != top.n[2] || f.size() != phi.size())
+			throw "Grid size mismatch";
+		memcpy(top.phi.data(), phi.data(), phi.size()*sizeof(T));
+		memcpy(top.f.data(), f.data(), f.size()*sizeof(T));
+		if(this->boundary == BOUNDARY_PERIODIC) removeMean(top.f);
+		const T scale = (fabs(top.f.max()) > fabs(top.f.min())) ? fabs(top.f.max()) : fabs(top.f.min());
+
+		int cycles = 0;
+		this->lastResidual = this->residual(top);
+		while(cycles < maxCycles && this->lastResidual > tolerance*scale) {
+			this->cycle(0);
+			if(this->boundary == BOUNDARY_PERIODIC) removeMean(top.phi);
+			this->lastResidual = this->residual(top);
+			cycles++;
+		}
+		memcpy(phi.data(), top.phi.data(), phi.size()*sizeof(T));
+		return cycles;
+	}
+};
+
+}
+
+#endif
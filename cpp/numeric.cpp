@@ -12,8 +12,23 @@
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <execution>
+#include <chrono>
+#include <omp.h>
 
 #include "numeric.hpp"
+#include "float16.hpp"
+#include "compressed.hpp"
+#include "particles.hpp"
+#include "multigrid.hpp"
+#include "fft.hpp"
+#include "filter.hpp"
+#include "integral.hpp"
+#include "pyramid.hpp"
 
 using namespace std;
 using namespace numeric;
@@ -103,15 +118,1209 @@ static void test_tesseract() {
 }
 
 
+static void test_iterators() {
+	Array<double> arr(N1);
+	std::iota(arr.begin(), arr.end(), 0.0);
+	if(std::accumulate(arr.cbegin(), arr.cend(), 0.0) != euler_sum(N1-1) || arr.data()[N1-1] != N1-1) {
+		cerr << "Array iterator error" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	Cube<double> c(N1,N2,N3);
+	std::fill(std::execution::par_unseq, c.begin(), c.end(), 2.0);
+	std::transform(std::execution::par_unseq, c.begin(), c.end(), c.begin(), [](const double x) { return x*x; });
+	const double c_sum = std::reduce(std::execution::par, c.cbegin(), c.cend(), 0.0);
+	if(c_sum != 4.0*N1*N2*N3) {
+		cerr << "Cube parallel algorithm error :" << c_sum << " != " << 4.0*N1*N2*N3 << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Index iterators must visit every cell in storage order
+	size_t cells = 0;
+	for(Cube<double>::index_iterator it = c.ibegin(); it != c.iend(); ++it) {
+		*it = it[0] + 100*it[1] + 10000*it[2];
+		cells++;
+	}
+	if(cells != c.size() || c(3,4,5) != 3+400+50000) {
+		cerr << "Cube index iterator error" << endl;
+		exit(EXIT_FAILURE);
+	}
+	const Tesseract<double> t(N1,N2,N3,N4);
+	cells = 0;
+	for(Tesseract<double>::const_index_iterator it = t.ibegin(); it != t.iend(); ++it) {
+		if(&(*it) != &t.data()[it[0]+N1*(it[1]+N2*(it[2]+N3*it[3]))]) {
+			cerr << "Tesseract index iterator error" << endl;
+			exit(EXIT_FAILURE);
+		}
+		cells++;
+	}
+	if(cells != t.size()) {
+		cerr << "Tesseract index iterator visited " << cells << " cells" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_float16() {
+	// Every non-NaN half value must survive the round trip through float
+	for(uint32_t h=0;h<=0xFFFF;h++) {
+		if((h & 0x7C00) == 0x7C00 && (h & 0x03FF) != 0) continue;
+		const float f = float16::toFloat((uint16_t)h);
+		if(float16::fromFloat(f) != h) {
+			cerr << "float16 round trip error for 0x" << hex << h << dec << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(float16(65520.0f).raw() != 0x7C00 || float16(1.0f + 1.0f/4096.0f).raw() != 0x3C00 || bfloat16(1.0f).raw() != 0x3F80) {
+		cerr << "Reduced precision rounding error" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Vectorized kernels must be bit-identical to the scalar conversion
+	const size_t n = 1001;
+	Array<float> src(n), back(n);
+	Array<double> dsrc(n), dback(n);
+	Array<float16> h(n);
+	Array<bfloat16> b(n);
+	srand(42);
+	for(size_t i=0;i<n;i++) {
+		src[i] = (float)((rand() / (double)RAND_MAX - 0.5) * 1e5 * (i % 7 == 0 ? 1e-9 : 1.0));
+		dsrc[i] = src[i];
+	}
+	convert(src.data(), h.data(), n);
+	convert(src.data(), b.data(), n);
+	for(size_t i=0;i<n;i++) {
+		if(h[i].raw() != float16::fromFloat(src[i]) || b[i].raw() != bfloat16::fromFloat(src[i])) {
+			cerr << "Vectorized conversion mismatch at " << i << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	convert(h.data(), back.data(), n);
+	convert(b.data(), dback.data(), n);
+	for(size_t i=0;i<n;i++) {
+		if(back[i] != (float)h[i] || dback[i] != (double)(float)b[i]) {
+			cerr << "Vectorized widening mismatch at " << i << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	convert(dsrc.data(), h.data(), n);
+	for(size_t i=0;i<n;i++) {
+		if(h[i].raw() != float16::fromFloat(src[i])) {
+			cerr << "Double to float16 conversion mismatch at " << i << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// NaN payloads must not depend on the code path: fill all lanes with signalling and quiet NaNs
+	const uint32_t nans[4] = {0x7F800001U, 0x7FA5A5A5U, 0xFF812345U, 0x7FC00000U};
+	Array<uint16_t> hnan(n);
+	for(size_t i=0;i<n;i++) {
+		memcpy(&src[i], &nans[i % 4], sizeof(float));
+		hnan[i] = (uint16_t)(0x7C01U + (i % 0x3FF));
+	}
+	convert(src.data(), h.data(), n);
+	convert((const float16*)hnan.data(), back.data(), n);
+	for(size_t i=0;i<n;i++) {
+		const float f = float16::toFloat(hnan[i]);
+		if(h[i].raw() != float16::fromFloat(src[i]) || memcmp(&f, &back[i], sizeof(float)) != 0) {
+			cerr << "NaN conversion mismatch at " << i << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Containers of reduced precision types
+	Matrix<float16> c(N1,4);
+	c = float16(0.5f);
+	c(3,2) = -2;
+	if(c.sum() != 0.5f*N1*4-2.5f || c.max() != 0.5f || c.min() != -2.0f || sizeof(c[0]) != 2) {
+		cerr << "float16 cube error: " << (float)c.sum() << endl;
+		exit(EXIT_FAILURE);
+	}
+	// Sums accumulate in float, a float16 accumulator stalls at 2048 when adding ones
+	Cube<float16> ones(16,16,16);
+	ones = float16(1.0f);
+	Cube<bfloat16> bones(16,16,16);
+	bones = bfloat16(1.0f);
+	if((float)ones.sum() != 4096.0f || (float)ones.avg() != 1.0f || (float)bones.sum() != 4096.0f) {
+		cerr << "float16 sum error: " << (float)ones.sum() << endl;
+		exit(EXIT_FAILURE);
+	}
+	// Axis sums over contiguous lines and over rows, and the cached sum
+	Cube<float16> line(4096,1,1);
+	line = float16(1.0f);
+	Matrix<float16> lineSum = line.sum(0);
+	Cube<float16> rows(4,4096,1);
+	rows = float16(1.0f);
+	Matrix<float16> rowSum = rows.sum(1);
+	ones.cacheReductions(256);
+	if((float)lineSum(0,0) != 4096.0f || (float)rowSum(3,0) != 4096.0f || (float)ones.sum() != 4096.0f) {
+		cerr << "float16 axis or cached sum error" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_compressed() {
+	// Codec round trip on compressible and incompressible data
+	const size_t n = 100000;
+	std::vector<uint8_t> src(n), packed(n), unpacked(n);
+	for(size_t i=0;i<n;i++) src[i] = (uint8_t)((i/100) % 7);
+	size_t bytes = codec::lz_compress(src.data(), n, packed.data(), n);
+	if(bytes == 0 || bytes > n/10 || codec::lz_decompress(packed.data(), bytes, unpacked.data(), n) != n || unpacked != src) {
+		cerr << "LZ codec round trip error (" << bytes << " bytes)" << endl;
+		exit(EXIT_FAILURE);
+	}
+	srand(7);
+	for(size_t i=0;i<n;i++) src[i] = (uint8_t)rand();
+	if(codec::lz_compress(src.data(), n, packed.data(), n) != 0) {
+		cerr << "LZ codec should refuse incompressible data" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Smooth field
+	Cube<double> c(N1,N2,N3*4);
+	for(Cube<double>::index_iterator it = c.ibegin(); it != c.iend(); ++it)
+		*it = 1.0 + 0.25*it[0] + 0.5*it[1]*it[1] + 0.125*it[2];
+	CompressedCube<double> cc(c, N1*N2, 2);
+	if(cc.ratio() <= 1.5 || cc.blockCount() != N3*4) {
+		cerr << "Compressed cube ratio too low: " << cc.ratio() << endl;
+		exit(EXIT_FAILURE);
+	}
+	if(cc(3,4,5) != c(3,4,5) || cc(N1-1,N2-1,N3*4-1) != c(N1-1,N2-1,N3*4-1)) {
+		cerr << "Compressed cube access error" << endl;
+		exit(EXIT_FAILURE);
+	}
+	// Modify more blocks than the cache holds to force write back on eviction
+	for(size_t k=0;k<N3*4;k++) {
+		cc.set(1,2,k, -1.0*k);
+		c(1,2,k) = -1.0*k;
+	}
+	Cube<double> d = cc.cube();
+	for(size_t i=0;i<c.size();i++) {
+		if(d[i] != c[i]) {
+			cerr << "Compressed cube round trip error at " << i << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void test_reduction_cache() {
+	Cube<double> c(N1,N2,N3);
+	c.cacheReductions(64);
+	for(Cube<double>::index_iterator it = c.ibegin(); it != c.iend(); ++it)
+		*it = (double)(it[0] + it[1] - it[2]);
+	// Compare against uncached copy after every kind of modification
+	const char* step = "initial";
+	for(int round=0;round<6;round++) {
+		const Cube<double> ref(c);
+		if(ref.cachesReductions() || !c.cachesReductions() || c.sum() != ref.sum() || c.min() != ref.min() || c.max() != ref.max() || c.sum() != ref.sum()) {
+			cerr << "Cached reduction error after " << step << ": " << c.sum() << " != " << ref.sum() << endl;
+			exit(EXIT_FAILURE);
+		}
+		switch(round) {
+		case 0: c(5,6,7) = 1000.0; step = "operator()"; break;
+		case 1: c[c.size()-1] = -1000.0; step = "operator[]"; break;
+		case 2: c.data()[100] = 500.0; step = "data()"; break;
+		case 3: c = 2.0; step = "constant assignment"; break;
+		case 4: c.resize(N2,N1,N3+1); c(1,1,1) = 3.0; step = "resize"; break;
+		}
+	}
+	Cube<double> other(N1,N1,N1);
+	other = 4.0;
+	c = other;
+	if(c.sum() != 4.0*N1*N1*N1 || c.size(2) != N1) {
+		cerr << "Cached reduction error after cube assignment" << endl;
+		exit(EXIT_FAILURE);
+	}
+	Cube<double> moved(std::move(c));
+	moved(0,0,0) = 0.0;
+	if(!moved.cachesReductions() || moved.sum() != 4.0*N1*N1*N1 - 4.0 || moved.avg() != moved.sum()/moved.size()) {
+		cerr << "Cached reduction error after move" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Writes through a pointer retained across sum() need an explicit invalidation
+	double* p = moved.data();
+	const double before = moved.sum();
+	p[10] += 8.0;
+	p[moved.size()-1] = -100.0;
+	moved.invalidateReductions();
+	const Cube<double> ref(moved);
+	if(moved.sum() != ref.sum() || moved.sum() == before || moved.min() != -100.0) {
+		cerr << "Cached reduction error after writes through a retained pointer" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_axis_reductions() {
+	Cube<double> c(N1,N2,N3);
+	for(Cube<double>::index_iterator it = c.ibegin(); it != c.iend(); ++it)
+		*it = (double)((it[0]*7 + it[1]*3 + it[2]*11) % 17);
+	for(size_t axis=0;axis<3;axis++) {
+		const Matrix<double> s = c.sum(axis), mn = c.min(axis), mx = c.max(axis), a = c.avg(axis);
+		const size_t d1 = (axis == 0) ? 1 : 0, d2 = (axis == 2) ? 1 : 2;
+		if(s.size(0) != c.size(d1) || s.size(1) != c.size(d2)) {
+			cerr << "Cube axis reduction dimension error for axis " << axis << endl;
+			exit(EXIT_FAILURE);
+		}
+		for(size_t i=0;i<c.size(d1);i++) {
+			for(size_t j=0;j<c.size(d2);j++) {
+				double ref_s = 0, ref_mn = 1e9, ref_mx = -1e9;
+				for(size_t l=0;l<c.size(axis);l++) {
+					size_t idx[3];
+					idx[axis] = l; idx[d1] = i; idx[d2] = j;
+					const double v = c(idx[0],idx[1],idx[2]);
+					ref_s += v;
+					if(v < ref_mn) ref_mn = v;
+					if(v > ref_mx) ref_mx = v;
+				}
+				if(s(i,j) != ref_s || mn(i,j) != ref_mn || mx(i,j) != ref_mx || a(i,j) != ref_s/c.size(axis)) {
+					cerr << "Cube axis reduction error for axis " << axis << " at " << i << "," << j << endl;
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+	}
+
+	Tesseract<double> t(N1,N2,N3,N4);
+	t = 1.0;
+	t(1,2,3,4) = 5.0;
+	for(size_t axis=0;axis<4;axis++) {
+		const Cube<double> s = t.sum(axis), mx = t.max(axis);
+		if(s.sum() != t.sum() || mx.max() != 5.0 || s.size()*t.size(axis) != t.size()) {
+			cerr << "Tesseract axis reduction error for axis " << axis << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(t.sum(3)(1,2,3) != N4+4.0 || t.sum(0)(2,3,4) != N1+4.0) {
+		cerr << "Tesseract axis reduction value error" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	Matrix<double> m(N1,N2);
+	m = 2.0;
+	if(m.sum(0).size() != N2 || m.sum(0)[3] != 2.0*N1 || m.sum(1).size() != N1 || m.avg(1)[7] != 2.0) {
+		cerr << "Matrix axis reduction error" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_gather() {
+	Cube<double> field(N1,N2,N3);
+	for(Cube<double>::index_iterator it = field.ibegin(); it != field.iend(); ++it)
+		*it = 1.0 + 0.5*it[0] - 0.25*it[1] + 2.0*it[2];
+
+	// Linear fields are reproduced exactly by CIC and TSC away from the periodic seam
+	const size_t n = 3000;
+	Array<double> x(n), y(n), z(n), out(n), sorted(n);
+	srand(3);
+	for(size_t p=0;p<n;p++) {
+		x[p] = 2.0 + (N1-5) * (rand() / (double)RAND_MAX);
+		y[p] = 2.0 + (N2-5) * (rand() / (double)RAND_MAX);
+		z[p] = 2.0 + (N3-5) * (rand() / (double)RAND_MAX);
+	}
+	const Shape shapes[] = { SHAPE_CIC, SHAPE_TSC };
+	for(int s=0;s<2;s++) {
+		gather(field, x.data(), y.data(), z.data(), out.data(), n, shapes[s]);
+		gather(field, x.data(), y.data(), z.data(), sorted.data(), n, shapes[s], true);
+		for(size_t p=0;p<n;p++) {
+			const double ref = 1.0 + 0.5*x[p] - 0.25*y[p] + 2.0*z[p];
+			if(fabs(out[p] - ref) > 1e-10 || out[p] != sorted[p]) {
+				cerr << "Gather error for shape " << shapes[s] << ": " << out[p] << " != " << ref << endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	gather(field, x.data(), y.data(), z.data(), out.data(), n, SHAPE_NGP);
+	for(size_t p=0;p<n;p++) {
+		if(out[p] != field((size_t)floor(x[p]+0.5), (size_t)floor(y[p]+0.5), (size_t)floor(z[p]+0.5))) {
+			cerr << "NGP gather error" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Periodic wrapping: Positions one period apart interpolate equally
+	for(size_t p=0;p<n;p++) {
+		sorted[p] = x[p] - 1.5*N1;
+		x[p] = sorted[p] + N1;
+	}
+	gather(field, sorted.data(), y.data(), z.data(), out.data(), n, SHAPE_TSC);
+	gather(field, x.data(), y.data(), z.data(), sorted.data(), n, SHAPE_TSC);
+	for(size_t p=0;p<n;p++) {
+		if(fabs(out[p] - sorted[p]) > 1e-9) {
+			cerr << "Periodic gather error" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void test_deposit() {
+	const size_t n = 5000;
+	Array<double> x(n), y(n), z(n), w(n), g(n);
+	srand(5);
+	for(size_t p=0;p<n;p++) {
+		x[p] = (N1+10) * (rand() / (double)RAND_MAX) - 5.0;
+		y[p] = N2 * (rand() / (double)RAND_MAX);
+		z[p] = 4.0*N3 * (rand() / (double)RAND_MAX);
+		w[p] = 0.5 + (p % 3);
+	}
+	Cube<double> field(N1,N2,4*N3);
+	for(Cube<double>::index_iterator it = field.ibegin(); it != field.iend(); ++it)
+		*it = sin(0.3*it[0]) + cos(0.2*it[1]*it[2]);
+
+	const Shape shapes[] = { SHAPE_NGP, SHAPE_CIC, SHAPE_TSC };
+	for(int s=0;s<3;s++) {
+		Cube<double> rho(N1,N2,4*N3);
+		deposit(rho, x.data(), y.data(), z.data(), w.data(), n, shapes[s]);
+		// Charge conservation
+		if(fabs(rho.sum() - w.sum()) > 1e-9) {
+			cerr << "Deposit charge error for shape " << shapes[s] << ": " << rho.sum() << " != " << w.sum() << endl;
+			exit(EXIT_FAILURE);
+		}
+		// Deposition is the adjoint of the gather with the same shape
+		gather(field, x.data(), y.data(), z.data(), g.data(), n, shapes[s]);
+		double grid = 0, particles = 0;
+		for(size_t i=0;i<rho.size();i++) grid += rho[i]*field[i];
+		for(size_t p=0;p<n;p++) particles += w[p]*g[p];
+		if(fabs(grid - particles) > 1e-8) {
+			cerr << "Deposit is not the adjoint of gather for shape " << shapes[s] << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void test_particle_array() {
+	std::vector<std::string> names;
+	names.push_back("x");
+	names.push_back("y");
+	names.push_back("w");
+	ParticleArray<double> particles(names);
+	const size_t n = 1000;
+	const size_t first = particles.append(n);
+	double* x = particles["x"];
+	double* w = particles.data(particles.component("w"));
+	for(size_t p=0;p<n;p++) {
+		x[p] = (double)p;
+		w[p] = 2.0*p;
+	}
+	if(first != 0 || particles.size() != n || particles.capacity() < n || ((size_t)x) % Array<double>::alignment != 0) {
+		cerr << "ParticleArray append error" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Bulk append from per-component arrays
+	const double xs[2] = {-1.0, -2.0}, ys[2] = {5.0, 6.0}, ws[2] = {7.0, 8.0};
+	const double* src[3] = {xs, ys, ws};
+	particles.append(src, 2);
+
+	// Remove every third particle
+	std::vector<unsigned char> mask(particles.size(), 0);
+	for(size_t p=0;p<n;p+=3) mask[p] = 1;
+	const size_t removed = particles.remove(mask.data());
+	x = particles["x"];
+	w = particles["w"];
+	size_t i = 0;
+	for(size_t p=0;p<n;p++) {
+		if(p % 3 == 0) continue;
+		if(x[i] != (double)p || w[i] != 2.0*p) {
+			cerr << "ParticleArray compaction error at " << i << endl;
+			exit(EXIT_FAILURE);
+		}
+		i++;
+	}
+	if(removed != (n+2)/3 || particles.size() != i+2 || x[i+1] != -2.0 || particles["y"][i] != 5.0) {
+		cerr << "ParticleArray remove error" << endl;
+		exit(EXIT_FAILURE);
+	}
+	particles.shrink();
+	if(particles.capacity() != particles.size() || particles["w"][i+1] != 8.0) {
+		cerr << "ParticleArray shrink error" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_cell_sort() {
+	std::vector<std::string> names;
+	names.push_back("x");
+	names.push_back("y");
+	names.push_back("z");
+	names.push_back("id");
+	const size_t n = 20000;
+	for(int morton=0;morton<2;morton++) {
+		ParticleArray<double> particles(names);
+		particles.append(n);
+		double *x = particles["x"], *y = particles["y"], *z = particles["z"], *id = particles["id"];
+		srand(11);
+		for(size_t p=0;p<n;p++) {
+			x[p] = N1 * (rand() / (double)RAND_MAX);
+			y[p] = N2 * (rand() / (double)RAND_MAX);
+			z[p] = N3 * (rand() / (double)RAND_MAX);
+			id[p] = 1000.0*x[p];
+		}
+		CellSort<double> sorter(N1,N2,N3,morton != 0);
+		for(int round=0;round<3;round++) {
+			if(round == 0)
+				sorter.sort(particles);
+			else if(round == 2) {
+				// Move every other particle, the update falls back to a full sort
+				for(size_t p=0;p<n;p+=2) {
+					x[p] = N1 * (rand() / (double)RAND_MAX);
+					id[p] = 1000.0*x[p];
+				}
+				if(sorter.update(particles) < n/10) {
+					cerr << "Cell sort update should fall back to a full sort" << endl;
+					exit(EXIT_FAILURE);
+				}
+			} else {
+				// Move a few particles, the update must only merge these
+				for(size_t p=0;p<n;p+=97) {
+					x[p] = N1 * (rand() / (double)RAND_MAX);
+					id[p] = 1000.0*x[p];
+				}
+				const size_t moved = sorter.update(particles);
+				if(moved == 0 || moved > n/50) {
+					cerr << "Incremental cell sort moved " << moved << " particles" << endl;
+					exit(EXIT_FAILURE);
+				}
+			}
+			// Every particle must be within its cell range, and the components must stay together
+			size_t counted = 0;
+			for(size_t k=0;k<N3;k++) {
+				for(size_t j=0;j<N2;j++) {
+					for(size_t i=0;i<N1;i++) {
+						for(size_t p=sorter.begin(i,j,k);p<sorter.end(i,j,k);p++) {
+							if(cellIndex(x[p], y[p], z[p], N1, N2, N3) != (k*N2+j)*N1+i || id[p] != 1000.0*x[p]) {
+								cerr << "Cell sort error (morton=" << morton << ", round " << round << ")" << endl;
+								exit(EXIT_FAILURE);
+							}
+							counted++;
+						}
+					}
+				}
+			}
+			if(counted != n) {
+				cerr << "Cell sort lost particles: " << counted << " != " << n << endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	// Several threads, with one cell per coarse bucket and with more cells than buckets.
+	// The sort must be stable
+	const size_t big = 200000;
+	const size_t grids[2] = {16, 64};
+	for(int g=0;g<2;g++) {
+		const size_t nc = grids[g];
+		ParticleArray<double> particles(names);
+		particles.append(big);
+		double *x = particles["x"], *y = particles["y"], *z = particles["z"], *id = particles["id"];
+		for(size_t p=0;p<big;p++) {
+			x[p] = nc * (rand() / (double)RAND_MAX);
+			y[p] = nc * (rand() / (double)RAND_MAX);
+			z[p] = nc * (rand() / (double)RAND_MAX);
+			id[p] = (double)p;
+		}
+		const int threads = omp_get_max_threads();
+		omp_set_num_threads(4);
+		CellSort<double> sorter(nc, nc, nc, true);
+		sorter.sort(particles);
+		omp_set_num_threads(threads);
+		for(size_t k=0;k<nc;k++)
+			for(size_t j=0;j<nc;j++)
+				for(size_t i=0;i<nc;i++)
+					for(size_t p=sorter.begin(i,j,k);p<sorter.end(i,j,k);p++)
+						if(cellIndex(x[p], y[p], z[p], nc, nc, nc) != (k*nc+j)*nc+i || (p > sorter.begin(i,j,k) && id[p] <= id[p-1])) {
+							cerr << "Parallel cell sort error in cell (" << i << "," << j << "," << k << ") of " << nc << "^3" << endl;
+							exit(EXIT_FAILURE);
+						}
+		if(sorter.table().back() != big || sorter.table().front() != 0) {
+			cerr << "Parallel cell sort offset table error" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void cross(const double* a, const double* b, double* r) {
+	r[0] = a[1]*b[2] - a[2]*b[1];
+	r[1] = a[2]*b[0] - a[0]*b[2];
+	r[2] = a[0]*b[1] - a[1]*b[0];
+}
+static double dot(const double* a, const double* b) { return a[0]*b[0] + a[1]*b[1] + a[2]*b[2]; }
 
+/** Scalar reference Boris (c > 0: relativistic) and Vay push of one particle */
+static void reference_push(double* x, double* u, const double* E, const double* B, const double qm, const double dt, const double c, const bool vay) {
+	const double h = 0.5*qm*dt;
+	double un[3], tmp[3], tmp2[3];
+	if(!vay) {
+		double um[3], t[3];
+		for(int i=0;i<3;i++) um[i] = u[i] + h*E[i];
+		const double g = (c > 0) ? sqrt(1.0 + dot(um,um)/(c*c)) : 1.0;
+		for(int i=0;i<3;i++) t[i] = h*B[i]/g;
+		cross(um, t, tmp);
+		for(int i=0;i<3;i++) tmp[i] += um[i];
+		cross(tmp, t, tmp2);
+		for(int i=0;i<3;i++) un[i] = um[i] + 2.0/(1.0+dot(t,t))*tmp2[i] + h*E[i];
+	} else {
+		double v[3], up[3], tau[3], t[3];
+		const double g = sqrt(1.0 + dot(u,u)/(c*c));
+		for(int i=0;i<3;i++) { v[i] = u[i]/g; tau[i] = h*B[i]; }
+		cross(v, tau, tmp);
+		for(int i=0;i<3;i++) up[i] = u[i] + 2.0*h*E[i] + tmp[i];
+		const double us = dot(up,tau)/c;
+		const double sigma = 1.0 + dot(up,up)/(c*c) - dot(tau,tau);
+		const double gn = sqrt(0.5*(sigma + sqrt(sigma*sigma + 4.0*(dot(tau,tau) + us*us))));
+		for(int i=0;i<3;i++) t[i] = tau[i]/gn;
+		cross(up, t, tmp);
+		const double s = 1.0/(1.0+dot(t,t));
+		for(int i=0;i<3;i++) un[i] = s*(up[i] + dot(up,t)*t[i] + tmp[i]);
+	}
+	const double gn = (c > 0) ? sqrt(1.0 + dot(un,un)/(c*c)) : 1.0;
+	for(int i=0;i<3;i++) {
+		u[i] = un[i];
+		x[i] += dt*un[i]/gn;
+	}
+}
 
+static void test_pusher() {
+	std::vector<std::string> names;
+	const char* components[] = {"x", "y", "z", "ux", "uy", "uz"};
+	for(int i=0;i<6;i++) names.push_back(components[i]);
+	const size_t n = 5003;
+	const double qm = -1.5, dt = 0.1, c = 3.0;
+	Array<double> fields[6];
+	for(int i=0;i<6;i++) fields[i].resize(n);
+	srand(13);
+	for(int mode=0;mode<3;mode++) {
+		// Compare the vectorized pushers against the scalar reference
+		ParticleArray<double> particles(names);
+		particles.append(n);
+		for(int i=0;i<6;i++) {
+			double* col = particles.data(i);
+			for(size_t p=0;p<n;p++) {
+				col[p] = 2.0*(rand() / (double)RAND_MAX) - 1.0;
+				fields[i][p] = 2.0*(rand() / (double)RAND_MAX) - 1.0;
+			}
+		}
+		ParticleArray<double> ref(particles);
+		const PushArrays<double> arrays(particles, fields[0].data(), fields[1].data(), fields[2].data(), fields[3].data(), fields[4].data(), fields[5].data());
+		if(mode == 0) borisPush(arrays, qm, dt);
+		else if(mode == 1) borisPush(arrays, qm, dt, c);
+		else vayPush(arrays, qm, dt, c);
+		for(size_t p=0;p<n;p++) {
+			double x[3], u[3], E[3], B[3];
+			for(int i=0;i<3;i++) {
+				x[i] = ref.data(i)[p];
+				u[i] = ref.data(3+i)[p];
+				E[i] = fields[i][p];
+				B[i] = fields[3+i][p];
+			}
+			reference_push(x, u, E, B, qm, dt, (mode == 0) ? 0.0 : c, mode == 2);
+			for(int i=0;i<3;i++) {
+				if(fabs(x[i] - particles.data(i)[p]) > 1e-12 || fabs(u[i] - particles.data(3+i)[p]) > 1e-12) {
+					cerr << "Pusher " << mode << " differs from scalar reference at particle " << p << endl;
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+	}
 
+	// Pure magnetic field conserves |u|, and Vay keeps the relativistic E x B drift exact
+	ParticleArray<double> particles(names, 1);
+	particles.append(1);
+	const double vd = 0.9*c, gd = 1.0/sqrt(1.0 - 0.81);
+	particles["ux"][0] = gd*vd;
+	const double Ey = vd*2.0, Bz = 2.0;
+	const double zero = 0.0;
+	const PushArrays<double> arrays(particles, &zero, &Ey, &zero, &zero, &zero, &Bz);
+	for(int step=0;step<1000;step++) vayPush(arrays, qm, dt, c);
+	if(fabs(particles["ux"][0] - gd*vd) > 1e-9 || fabs(particles["uy"][0]) > 1e-9 || fabs(particles["x"][0] - 1000*dt*vd) > 1e-6) {
+		cerr << "Vay pusher E x B drift error: u = (" << particles["ux"][0] << "," << particles["uy"][0] << ")" << endl;
+		exit(EXIT_FAILURE);
+	}
+	particles["uy"][0] = 1.0;
+	const double u0 = sqrt(particles["ux"][0]*particles["ux"][0] + 1.0);
+	const PushArrays<double> gyration(particles, &zero, &zero, &zero, &zero, &zero, &Bz);
+	for(int step=0;step<1000;step++) borisPush(gyration, qm, dt, c);
+	if(fabs(sqrt(particles["ux"][0]*particles["ux"][0] + particles["uy"][0]*particles["uy"][0]) - u0) > 1e-10) {
+		cerr << "Boris pusher does not conserve |u| in a magnetic field" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
 
+static void test_multigrid() {
+	// Discrete eigenmodes of the Laplacian: lap(phi) = lambda*phi holds exactly
+	const size_t nx = 32, ny = 16, nz = 24;
+	const double h[3] = {0.1, 0.2, 0.15};
+	const size_t n[3] = {nx, ny, nz};
+	for(int bc=0;bc<2;bc++) {
+		const Boundary boundary = (bc == 0) ? BOUNDARY_PERIODIC : BOUNDARY_DIRICHLET;
+		double k[3], lambda = 0;
+		for(int d=0;d<3;d++) {
+			k[d] = (bc == 0) ? 2.0*M_PI*(d+1)/n[d] : M_PI*(d+1)/n[d];
+			lambda += (2.0*cos(k[d]) - 2.0)/(h[d]*h[d]);
+		}
+		Cube<double> exact(nx, ny, nz), f(nx, ny, nz);
+		for(size_t z=0;z<nz;z++) {
+			for(size_t y=0;y<ny;y++) {
+				for(size_t x=0;x<nx;x++) {
+					// Dirichlet modes vanish at the outer cell faces
+					const double off = (bc == 0) ? 0.0 : 0.5;
+					exact(x,y,z) = sin(k[0]*(x+off)) * sin(k[1]*(y+off)) * sin(k[2]*(z+off));
+					f(x,y,z) = lambda * exact(x,y,z) + ((bc == 0) ? 3.0 : 0.0);
+				}
+			}
+		}
+		for(int gamma=1;gamma<=2;gamma++) {
+			Multigrid<double> mg(nx, ny, nz, h[0], h[1], h[2], boundary);
+			mg.setCycle(gamma);
+			if(mg.depth() != 4) {
+				cerr << "Multigrid has " << mg.depth() << " levels, expected 4" << endl;
+				exit(EXIT_FAILURE);
+			}
+			Cube<double> phi(nx, ny, nz);
+			phi = 0.0;
+			const int cycles = mg.solve(phi, f, 1e-10);
+			if(cycles > 20) {
+				cerr << "Multigrid (boundary " << bc << ", gamma " << gamma << ") needs " << cycles << " cycles" << endl;
+				exit(EXIT_FAILURE);
+			}
+			for(size_t i=0;i<phi.size();i++) {
+				if(fabs(phi[i] - exact[i]) > 1e-8) {
+					cerr << "Multigrid solution error (boundary " << bc << ", gamma " << gamma << ") at " << i << ": " << phi[i] << " != " << exact[i] << endl;
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+	}
+
+	// Odd periodic extents: the result must not depend on the number of threads
+	const size_t odd = 15;
+	Cube<double> rhs(odd, odd, odd), phi1(odd, odd, odd), phi4(odd, odd, odd);
+	for(Cube<double>::index_iterator it = rhs.ibegin(); it != rhs.iend(); ++it)
+		*it = sin(2.0*M_PI*it[0]/odd) + cos(2.0*M_PI*(it[1]+2*it[2])/odd);
+	const int threads = omp_get_max_threads();
+	Multigrid<double> single(odd, odd, odd, 1.0, 1.0, 1.0);
+	phi1 = 0.0;
+	omp_set_num_threads(1);
+	single.solve(phi1, rhs, 1e-12, 30);
+	Multigrid<double> parallel(odd, odd, odd, 1.0, 1.0, 1.0);
+	phi4 = 0.0;
+	omp_set_num_threads(4);
+	parallel.solve(phi4, rhs, 1e-12, 30);
+	omp_set_num_threads(threads);
+	for(size_t i=0;i<phi1.size();i++) {
+		if(phi1[i] != phi4[i]) {
+			cerr << "Multigrid result on an odd grid depends on the number of threads at " << i << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// A grid that cannot be coarsened is solved on the coarsest level, not smoothed there
+	const size_t nc = 33;
+	Cube<double> f(nc, nc, nc), phi(nc, nc, nc);
+	srand(7);
+	for(size_t i=0;i<f.size();i++) f[i] = rand() / (double)RAND_MAX - 0.5;
+	Multigrid<double> coarse(nc, nc, nc, 1.0, 1.0, 1.0, BOUNDARY_DIRICHLET);
+	phi = 0.0;
+	const int cycles = coarse.solve(phi, f, 1e-10, 20);
+	if(coarse.depth() != 1 || cycles > 5 || coarse.residual() > 1e-10*0.5) {
+		cerr << "Multigrid on an uncoarsened " << nc << "^3 grid needs " << cycles << " cycles, residual " << coarse.residual() << endl;
+		exit(EXIT_FAILURE);
+	}
+	coarse.setCoarseSolve(1e-3, 5);
+	bool thrown = false;
+	try {
+		phi = 0.0;
+		coarse.solve(phi, f);
+	} catch (const char*) {
+		thrown = true;
+	}
+	if(!thrown) {
+		cerr << "Multigrid does not report a coarsest level that does not converge" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_fft() {
+	typedef std::complex<double> complex;
+	// Compare against a direct DFT for lengths covering all radices
+	const size_t lengths[] = {1, 2, 3, 4, 5, 6, 7, 8, 12, 15, 16, 30, 49, 60, 64, 97, 100, 120, 243};
+	srand(17);
+	for(size_t l=0;l<sizeof(lengths)/sizeof(size_t);l++) {
+		const size_t n = lengths[l];
+		Array<complex> a(n);
+		Array<double> real(n);
+		for(size_t i=0;i<n;i++) {
+			a[i] = complex(rand() / (double)RAND_MAX - 0.5, rand() / (double)RAND_MAX - 0.5);
+			real[i] = a[i].real();
+		}
+		Array<complex> f(a);
+		fft(f);
+		const Array<complex> rf = rfft(real);
+		for(size_t k=0;k<n;k++) {
+			complex sum = 0, rsum = 0;
+			for(size_t j=0;j<n;j++) {
+				const complex w = std::polar(1.0, -2.0*M_PI*(double)((j*k) % n)/(double)n);
+				sum += a[j]*w;
+				rsum += real[j]*w;
+			}
+			if(std::abs(sum - f[k]) > 1e-10*n || (k <= n/2 && std::abs(rsum - rf[k]) > 1e-10*n)) {
+				cerr << "FFT of length " << n << " differs from DFT at " << k << endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+		fft(f, true);
+		const Array<double> rb = irfft(rf, n);
+		for(size_t i=0;i<n;i++) {
+			if(std::abs(f[i] - a[i]) > 1e-12 || fabs(rb[i] - real[i]) > 1e-12) {
+				cerr << "Inverse FFT of length " << n << " is not the identity" << endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	// A plane wave transforms to a single coefficient; real and complex Cube transforms agree
+	const size_t nx = 12, ny = 10, nz = 9;
+	Cube<double> wave(nx, ny, nz);
+	Cube<complex> cwave(nx, ny, nz);
+	for(size_t z=0;z<nz;z++) {
+		for(size_t y=0;y<ny;y++) {
+			for(size_t x=0;x<nx;x++) {
+				wave(x,y,z) = cos(2.0*M_PI*(2.0*x/nx + 3.0*y/ny + 1.0*z/nz));
+				cwave(x,y,z) = wave(x,y,z);
+			}
+		}
+	}
+	const Cube<complex> spectrum = rfft(wave);
+	fft(cwave);
+	if(spectrum.size(0) != nx/2+1) {
+		cerr << "Real Cube spectrum has wrong size" << endl;
+		exit(EXIT_FAILURE);
+	}
+	for(size_t z=0;z<nz;z++) {
+		for(size_t y=0;y<ny;y++) {
+			for(size_t x=0;x<nx/2+1;x++) {
+				const double expected = (x == 2 && y == 3 && z == 1) ? 0.5*nx*ny*nz : 0.0;
+				if(std::abs(spectrum(x,y,z) - expected) > 1e-9 || std::abs(cwave(x,y,z) - spectrum(x,y,z)) > 1e-9) {
+					cerr << "Cube FFT error at (" << x << "," << y << "," << z << ")" << endl;
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+	}
+	const Cube<double> back = irfft(spectrum, nx);
+	fft(cwave, true);
+	for(size_t i=0;i<wave.size();i++) {
+		if(fabs(back[i] - wave[i]) > 1e-12 || std::abs(cwave[i] - wave[i]) > 1e-12) {
+			cerr << "Inverse Cube FFT is not the identity" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	Matrix<double> plane(nx, ny);
+	for(size_t i=0;i<plane.size();i++) plane[i] = wave[i];
+	const Matrix<double> pb = irfft(rfft(plane), nx);
+	for(size_t i=0;i<plane.size();i++) {
+		if(fabs(pb[i] - plane[i]) > 1e-12) {
+			cerr << "Inverse Matrix FFT is not the identity" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// The convenience transforms share their plans
+	if(sharedPlan<FFTPlan<double>>(97) != sharedPlan<FFTPlan<double>>(97) || sharedPlan<FFTPlan<double>>(97)->size() != 97 || sharedPlan<RealFFTPlan<double>>(97) != sharedPlan<RealFFTPlan<double>>(97)) {
+		cerr << "FFT plans are not shared" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_filter() {
+	const std::vector<double> binomial = binomialKernel<double>(4);
+	const double expected[] = {1.0/16, 4.0/16, 6.0/16, 4.0/16, 1.0/16};
+	for(int i=0;i<5;i++) {
+		if(fabs(binomial[i] - expected[i]) > 1e-15) {
+			cerr << "Binomial kernel error" << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	const std::vector<double> gauss = gaussianKernel<double>(1.5);
+	if(gauss.size() != 11 || fabs(std::accumulate(gauss.begin(), gauss.end(), 0.0) - 1.0) > 1e-14 || gauss[2] != gauss[8]) {
+		cerr << "Gaussian kernel error" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Compare the separable filter against a direct 3D convolution with asymmetric kernels
+	const size_t nx = 70, ny = 9, nz = 7;
+	const double kx[] = {0.1, 0.5, 0.2}, ky[] = {0.3, -0.2, 1.0, 0.4, 0.05}, kz[] = {2.0};
+	const std::vector<double> vx(kx, kx+3), vy(ky, ky+5), vz(kz, kz+1);
+	Cube<double> src(nx, ny, nz);
+	srand(3);
+	for(size_t i=0;i<src.size();i++) src[i] = rand() / (double)RAND_MAX;
+	for(int p=0;p<3;p++) {
+		const Padding padding = (Padding)p;
+		Cube<double> filtered(src);
+		convolve(filtered, vx, vy, vz, padding);
+		for(size_t z=0;z<nz;z++) {
+			for(size_t y=0;y<ny;y++) {
+				for(size_t x=0;x<nx;x++) {
+					double sum = 0;
+					for(int b=0;b<5;b++) {
+						for(int a=0;a<3;a++) {
+							long i = (long)x - a + 1, j = (long)y - b + 2;
+							if(padding == PADDING_PERIODIC) {
+								i = (i + nx) % nx;
+								j = (j + ny) % ny;
+							} else if(padding == PADDING_CLAMP) {
+								i = std::min(std::max(i, 0L), (long)nx-1);
+								j = std::min(std::max(j, 0L), (long)ny-1);
+							} else if(i < 0 || j < 0 || i >= (long)nx || j >= (long)ny) continue;
+							sum += kx[a] * ky[b] * kz[0] * src(i,j,z);
+						}
+					}
+					if(fabs(sum - filtered(x,y,z)) > 1e-12) {
+						cerr << "Separable convolution (padding " << p << ") error at (" << x << "," << y << "," << z << ")" << endl;
+						exit(EXIT_FAILURE);
+					}
+				}
+			}
+		}
+	}
+
+	// An impulse reproduces the kernel in order
+	Matrix<double> impulse(9, 4);
+	impulse = 0.0;
+	impulse(4,1) = 1.0;
+	convolve(impulse, vx, vy, PADDING_ZERO);
+	for(size_t y=0;y<4;y++)
+		for(size_t x=0;x<9;x++) {
+			const double expected = (x >= 3 && x <= 5 && y <= 3) ? kx[x-3]*ky[y+1] : 0.0;
+			if(fabs(impulse(x,y) - expected) > 1e-15) {
+				cerr << "Impulse response error at (" << x << "," << y << "): " << impulse(x,y) << " != " << expected << endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+
+	// Periodic smoothing conserves the total
+	Cube<double> smooth(src);
+	smoothBinomial(smooth);
+	smoothGaussian(smooth, 1.0);
+	if(fabs(smooth.sum() - src.sum()) > 1e-9 || smooth.max() >= src.max()) {
+		cerr << "Smoothing does not conserve the total" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_integral() {
+	const size_t nx = 23, ny = 17, nz = 11;
+	Cube<int> c(nx, ny, nz);
+	srand(5);
+	for(size_t i=0;i<c.size();i++) c[i] = rand() % 100 - 50;
+	const IntegralVolume<> volume(c);
+	Matrix<float> m(nx, ny);
+	for(size_t i=0;i<m.size();i++) m[i] = (float)c[i];
+	const IntegralImage<> image(m);
+
+	// Random boxes, including empty ones and the full domain, against direct sums
+	const size_t n = 200;
+	std::vector<Box<3>> boxes(n);
+	std::vector<Box<2>> rects(n);
+	for(size_t b=0;b<n;b++) {
+		for(int d=0;d<3;d++) {
+			const size_t len = c.size(d);
+			size_t lo = rand() % (len+1), hi = rand() % (len+1);
+			if(lo > hi && b % 7 != 0) std::swap(lo, hi);
+			if(b == 0) {
+				lo = 0;
+				hi = len;
+			}
+			boxes[b].lo[d] = lo;
+			boxes[b].hi[d] = hi;
+			if(d < 2) {
+				rects[b].lo[d] = lo;
+				rects[b].hi[d] = hi;
+			}
+		}
+	}
+	std::vector<double> sums(n), rsums(n);
+	volume.sum(boxes.data(), sums.data(), n);
+	image.sum(rects.data(), rsums.data(), n);
+	for(size_t b=0;b<n;b++) {
+		double sum = 0, rsum = 0;
+		for(size_t z=boxes[b].lo[2];z<boxes[b].hi[2];z++)
+			for(size_t y=boxes[b].lo[1];y<boxes[b].hi[1];y++)
+				for(size_t x=boxes[b].lo[0];x<boxes[b].hi[0];x++) sum += c(x,y,z);
+		for(size_t y=rects[b].lo[1];y<rects[b].hi[1];y++)
+			for(size_t x=rects[b].lo[0];x<rects[b].hi[0];x++) rsum += m(x,y);
+		if(sum != sums[b] || sum != volume.sum(boxes[b]) || rsum != rsums[b]) {
+			cerr << "Summed-area table error for box " << b << ": " << sums[b] << " != " << sum << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(volume.sum(0,0,0,nx,ny,nz) != c.sum() || fabs(volume.avg(1,2,3,4,5,6) - volume.sum(1,2,3,4,5,6)/27.0) > 1e-12) {
+		cerr << "Summed-area table total or average error" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_pyramid() {
+	// Odd sizes and more levels than one tile pass, against level-by-level reduction
+	const size_t nx = 37, ny = 20, nz = 9;
+	Cube<double> src(nx, ny, nz);
+	srand(9);
+	for(size_t i=0;i<src.size();i++) src[i] = rand() / (double)RAND_MAX;
+	for(int m=0;m<3;m++) {
+		const Downsampling mode = (Downsampling)m;
+		const Pyramid<double> pyramid(src, mode);
+		if(pyramid.depth() != 6 || pyramid.level(5).size() != 1 || pyramid[0].size(0) != 19 || pyramid[0].size(2) != 5) {
+			cerr << "Pyramid has wrong levels" << endl;
+			exit(EXIT_FAILURE);
+		}
+		const Cube<double>* below = &src;
+		for(size_t l=0;l<pyramid.depth();l++) {
+			const Cube<double> &level = pyramid.level(l);
+			for(size_t z=0;z<level.size(2);z++) {
+				for(size_t y=0;y<level.size(1);y++) {
+					for(size_t x=0;x<level.size(0);x++) {
+						double sum = 0, max = -1, min = 2;
+						int count = 0;
+						for(size_t k=2*z;k<std::min(2*z+2, below->size(2));k++) {
+							for(size_t j=2*y;j<std::min(2*y+2, below->size(1));j++) {
+								for(size_t i=2*x;i<std::min(2*x+2, below->size(0));i++) {
+									const double v = (*below)(i,j,k);
+									sum += v;
+									max = std::max(max, v);
+									min = std::min(min, v);
+									count++;
+								}
+							}
+						}
+						const double expected = (m == 0) ? sum/count : ((m == 1) ? max : min);
+						if(fabs(level(x,y,z) - expected) > 1e-14) {
+							cerr << "Pyramid level " << l << " (mode " << m << ") error at (" << x << "," << y << "," << z << ")" << endl;
+							exit(EXIT_FAILURE);
+						}
+					}
+				}
+			}
+			below = &level;
+		}
+	}
+	const Pyramid<double> shallow(src, DOWNSAMPLE_MAX, 2);
+	if(shallow.levels().size() != 2 || shallow.level(1).max() != src.max() || Pyramid<double>::scale(1) != 4) {
+		cerr << "Pyramid with fixed depth error" << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Integer averages must not wrap in T. The border cell has four children, (255+3*200)/4
+	Cube<uint8_t> bytes(9, 8, 8);
+	bytes = (uint8_t)200;
+	bytes(8,0,0) = 255;
+	const Pyramid<uint8_t> bytePyramid(bytes);
+	Cube<int32_t> ints(4, 4, 4);
+	ints = 2000000000;
+	const Pyramid<int32_t> intPyramid(ints);
+	if(bytePyramid.level(0)(0,0,0) != 200 || bytePyramid.level(0)(4,0,0) != 213 || intPyramid.level(1)(0,0,0) != 2000000000) {
+		cerr << "Integer pyramid error: " << (int)bytePyramid.level(0)(0,0,0) << " " << (int)bytePyramid.level(0)(4,0,0) << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+/* ==== Benchmarks, run with 'numeric bench' ================================= */
+
+/** Wall clock time in seconds */
+static double wtime() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void bench_compressed() {
+	const size_t n = 128;
+	const int reps = 5;
+	Cube<double> c(n,n,n);
+	for(Cube<double>::index_iterator it = c.ibegin(); it != c.iend(); ++it)
+		*it = sin(0.05*it[0]) * cos(0.03*it[1]) + 0.01*it[2];
+	const double mb = c.size()*sizeof(double) / 1e6;
+	for(int q=0;q<2;q++) {
+		// Full precision and quantised to multiples of 2^-10
+		if(q == 1) for(size_t i=0;i<c.size();i++) c[i] = floor(c[i]*1024.0) / 1024.0;
+		CompressedCube<double> cc(c);
+		double t0 = wtime();
+		for(int r=0;r<reps;r++) cc.compress(c.data(), c.size());
+		const double tc = (wtime() - t0) / reps;
+		Cube<double> d(n,n,n);
+		t0 = wtime();
+		for(int r=0;r<reps;r++) cc.decompress(d.data());
+		const double td = (wtime() - t0) / reps;
+		cout << "CompressedCube 128^3 " << (q == 0 ? "smooth   " : "quantised") << ": ratio " << cc.ratio()
+			<< ", compress " << mb/tc << " MB/s, decompress " << mb/td << " MB/s" << endl;
+	}
+}
+
+/** CIC deposition with atomic updates, the baseline of bench_deposit */
+static void deposit_atomic(Cube<double> &target, const double* x, const double* y, const double* z, const double* w, const size_t n) {
+	const size_t nx = target.size(0), ny = target.size(1), nz = target.size(2);
+	double* val = target.data();
+	#pragma omp parallel for schedule(static)
+	for(long p=0;p<(long)n;p++) {
+		long i0, j0, k0;
+		double wx[2], wy[2], wz[2];
+		shapeWeights<2>(wrapPosition(x[p], nx), i0, wx);
+		shapeWeights<2>(wrapPosition(y[p], ny), j0, wy);
+		shapeWeights<2>(wrapPosition(z[p], nz), k0, wz);
+		for(int c=0;c<2;c++)
+			for(int b=0;b<2;b++)
+				for(int a=0;a<2;a++) {
+					const size_t cell = (wrapIndex(k0+c, nz)*ny + wrapIndex(j0+b, ny))*nx + wrapIndex(i0+a, nx);
+					#pragma omp atomic
+					val[cell] += w[p]*wx[a]*wy[b]*wz[c];
+				}
+	}
+}
+
+static void bench_deposit() {
+	const size_t n = 128, np = 4000000;
+	const int reps = 3;
+	Array<double> x(np), y(np), z(np), w(np);
+	srand(11);
+	for(size_t p=0;p<np;p++) {
+		x[p] = n * (rand() / (double)RAND_MAX);
+		y[p] = n * (rand() / (double)RAND_MAX);
+		z[p] = n * (rand() / (double)RAND_MAX);
+		w[p] = 1.0;
+	}
+	Cube<double> rho(n,n,n);
+	const int threads = omp_get_max_threads();
+	const Shape shapes[] = { SHAPE_CIC, SHAPE_TSC };
+	const char* names[] = { "CIC", "TSC" };
+	for(int s=0;s<2;s++) {
+		double t0 = wtime();
+		for(int r=0;r<reps;r++) deposit(rho, x.data(), y.data(), z.data(), w.data(), np, shapes[s]);
+		const double tpar = (wtime() - t0) / reps;
+		omp_set_num_threads(1);
+		t0 = wtime();
+		for(int r=0;r<reps;r++) deposit(rho, x.data(), y.data(), z.data(), w.data(), np, shapes[s]);
+		const double tser = (wtime() - t0) / reps;
+		omp_set_num_threads(threads);
+		cout << "deposit " << names[s] << " 4M particles on 128^3: " << threads << " threads " << 1e3*tpar << " ms, serial " << 1e3*tser << " ms";
+		if(shapes[s] == SHAPE_CIC) {
+			t0 = wtime();
+			for(int r=0;r<reps;r++) deposit_atomic(rho, x.data(), y.data(), z.data(), w.data(), np);
+			cout << ", atomic " << 1e3*(wtime() - t0)/reps << " ms";
+		}
+		cout << endl;
+	}
+}
+
+static void bench_push() {
+	std::vector<std::string> names;
+	const char* components[] = {"x", "y", "z", "ux", "uy", "uz"};
+	for(int i=0;i<6;i++) names.push_back(components[i]);
+	const size_t n = 1000000;
+	const int reps = 5;
+	const double qm = -1.5, dt = 0.01, c = 3.0;
+	ParticleArray<double> particles(names);
+	particles.append(n);
+	Array<double> fields[6];
+	srand(13);
+	for(int i=0;i<6;i++) {
+		fields[i].resize(n);
+		double* col = particles.data(i);
+		for(size_t p=0;p<n;p++) {
+			col[p] = 2.0*(rand() / (double)RAND_MAX) - 1.0;
+			fields[i][p] = 2.0*(rand() / (double)RAND_MAX) - 1.0;
+		}
+	}
+	const PushArrays<double> arrays(particles, fields[0].data(), fields[1].data(), fields[2].data(), fields[3].data(), fields[4].data(), fields[5].data());
+	const char* modes[] = { "Boris", "Boris relativistic", "Vay" };
+	for(int mode=0;mode<3;mode++) {
+		double t0 = wtime();
+		for(int r=0;r<reps;r++) {
+			if(mode == 0) borisPush(arrays, qm, dt);
+			else if(mode == 1) borisPush(arrays, qm, dt, c);
+			else vayPush(arrays, qm, dt, c);
+		}
+		const double tvec = (wtime() - t0) / reps;
+		// Scalar reference, one particle at a time
+		t0 = wtime();
+		for(int r=0;r<reps;r++) {
+			for(size_t p=0;p<n;p++) {
+				double x[3], u[3], E[3], B[3];
+				for(int i=0;i<3;i++) {
+					x[i] = particles.data(i)[p];
+					u[i] = particles.data(3+i)[p];
+					E[i] = fields[i][p];
+					B[i] = fields[3+i][p];
+				}
+				reference_push(x, u, E, B, qm, dt, (mode == 0) ? 0.0 : c, mode == 2);
+				for(int i=0;i<3;i++) {
+					particles.data(i)[p] = x[i];
+					particles.data(3+i)[p] = u[i];
+				}
+			}
+		}
+		const double tref = (wtime() - t0) / reps;
+		cout << "push " << modes[mode] << " 1M particles: " << n/tvec/1e6 << " M particles/s, scalar reference " << n/tref/1e6 << " M particles/s" << endl;
+	}
+}
+
+static void bench_multigrid() {
+	// 128^3 coarsens to 2^3, 96^3 to 3^3 and 65^3 not at all (conjugate gradients only)
+	const size_t sizes[] = {128, 96, 65};
+	for(size_t s=0;s<sizeof(sizes)/sizeof(size_t);s++) {
+		const size_t n = sizes[s];
+		Cube<double> f(n, n, n), phi(n, n, n);
+		srand(19);
+		for(size_t i=0;i<f.size();i++) f[i] = rand() / (double)RAND_MAX - 0.5;
+		for(int gamma=1;gamma<=2;gamma++) {
+			Multigrid<double> mg(n, n, n, 1.0, 1.0, 1.0);
+			mg.setCycle(gamma);
+			phi = 0.0;
+			cout << "multigrid " << n << "^3 " << ((gamma == 1) ? "V" : "W") << "-cycles, " << mg.depth() << " levels, residual per cycle:";
+			int cycles = 0;
+			double elapsed = 0;
+			while(cycles < 15) {
+				const double t0 = wtime();
+				const int done = mg.solve(phi, f, 1e-10, 1);
+				elapsed += wtime() - t0;
+				if(done == 0) break;
+				cycles++;
+				cout << " " << mg.residual();
+			}
+			cout << endl << "    " << cycles << " cycles in " << elapsed << " s, " << n*n*n*(double)cycles/elapsed/1e6 << " M cells/s per cycle" << endl;
+		}
+	}
+}
+
+static void bench() {
+	cout << "Threads: " << omp_get_max_threads() << endl;
+	bench_compressed();
+	bench_deposit();
+	bench_push();
+	bench_multigrid();
+}
+
+
+int main(int argc, char** argv) {
+	if(argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench();
+		return EXIT_SUCCESS;
+	}
 
-int main() { //int argc, char** argv) {
 	test_array();
 	test_cube();
     test_tesseract();
+    test_iterators();
+    test_float16();
+    test_compressed();
+    test_reduction_cache();
+    test_axis_reductions();
+    test_gather();
+    test_deposit();
+    test_particle_array();
+    test_cell_sort();
+    test_pusher();
+    test_multigrid();
+    test_fft();
+    test_filter();
+    test_integral();
+    test_pyramid();
 
     cout << "All good" << endl;
     return EXIT_SUCCESS;
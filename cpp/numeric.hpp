@@ -13,85 +13,383 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
 namespace numeric {
 
+/**
+ * Forward iterator over all cells of a N-dimensional container that keeps track
+ * of the cell index. Cells are visited in storage order, i.e. the first index is
+ * the fastest one. Dereferencing yields the cell value, operator[] the index in
+ * the given dimension
+ */
+template <class T, size_t N>
+class IndexIterator {
+protected:
+	T* ptr;
+	const size_t* dims;
+	size_t idx[N];
+public:
+	typedef std::forward_iterator_tag iterator_category;
+	typedef typename std::remove_const<T>::type value_type;
+	typedef ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef T& reference;
+
+	IndexIterator() : ptr(NULL), dims(NULL) {
+		for(size_t d=0;d<N;d++) idx[d] = 0;
+	}
+	IndexIterator(T* ptr, const size_t* dims) : ptr(ptr), dims(dims) {
+		for(size_t d=0;d<N;d++) idx[d] = 0;
+	}
+
+	T& operator*() const { return *ptr; }
+	T* operator->() const { return ptr; }
+	/** @return index of the current cell in dimension d */
+	size_t operator[](const size_t d) const { return this->idx[d]; }
+	/** @return index array of the current cell, of size N */
+	const size_t* index() const { return this->idx; }
+
+	IndexIterator& operator++() {
+		++ptr;
+		for(size_t d=0;d<N;d++) {
+			if(++idx[d] < dims[d] || d == N-1) break;
+			idx[d] = 0;
+		}
+		return *this;
+	}
+	IndexIterator operator++(int) {
+		IndexIterator ret(*this);
+		++(*this);
+		return ret;
+	}
+	bool operator==(const IndexIterator &it) const { return this->ptr == it.ptr; }
+	bool operator!=(const IndexIterator &it) const { return this->ptr != it.ptr; }
+};
+
+/**
+ * Properties of the element types of the containers. Sums are accumulated in accum_type,
+ * which storage types with a short mantissa (see float16.hpp) specialize as float
+ */
+template <class T>
+struct numeric_traits {
+	typedef T accum_type;
+};
+
 template <class T>
 class Array {
+public:
+	/** Type in which sums of elements are accumulated */
+	typedef typename numeric_traits<T>::accum_type accum_type;
+
 protected:
+	/** Cached per-block and total reductions, see cacheReductions() */
+	struct ReductionCache {
+		/** log2 of the number of elements per block */
+		unsigned shift;
+		std::vector<accum_type> sum;
+		std::vector<T> min, max;
+		std::vector<unsigned char> dirty;
+		/** true if the totals are up to date */
+		bool valid;
+		accum_type total_sum;
+		T total_min, total_max;
+
+		ReductionCache(const unsigned shift) : shift(shift), valid(false) {}
+		void resize(const size_t n) {
+			const size_t blocks = (n + (size_t(1) << shift) - 1) >> shift;
+			sum.resize(blocks);
+			min.resize(blocks);
+			max.resize(blocks);
+			dirty.assign(blocks, 1);
+			valid = false;
+		}
+	};
+
 	T* val;
 	size_t n;
+	/** Reduction cache or NULL if disabled */
+	mutable ReductionCache* cache;
+
+	/** Mark element i as modified */
+	void touch(const size_t i) {
+		if(this->cache != NULL) {
+			this->cache->dirty[i >> this->cache->shift] = 1;
+			this->cache->valid = false;
+		}
+	}
+	/** Mark all elements as modified */
+	void touch() {
+		if(this->cache != NULL) this->cache->resize(this->n);
+	}
+
+	/** Recompute the modified blocks and the totals of the reduction cache */
+	void refresh() const {
+		ReductionCache &c = *this->cache;
+		if(c.valid) return;
+		const long blocks = (long)c.dirty.size();
+		#pragma omp parallel for schedule(static) if(blocks > 16)
+		for(long b=0;b<blocks;b++) {
+			if(!c.dirty[b]) continue;
+			const size_t begin = (size_t)b << c.shift;
+			const size_t end = (begin + (size_t(1) << c.shift) < this->n) ? begin + (size_t(1) << c.shift) : this->n;
+			accum_type s(0);
+			T mn = this->val[begin], mx = this->val[begin];
+			for(size_t i=begin;i<end;i++) {
+				s += this->val[i];
+				if(this->val[i] < mn) mn = this->val[i];
+				if(this->val[i] > mx) mx = this->val[i];
+			}
+			c.sum[b] = s;
+			c.min[b] = mn;
+			c.max[b] = mx;
+			c.dirty[b] = 0;
+		}
+		c.total_sum = accum_type(0);
+		c.total_min = c.min[0];
+		c.total_max = c.max[0];
+		for(long b=0;b<blocks;b++) {
+			c.total_sum += c.sum[b];
+			if(c.min[b] < c.total_min) c.total_min = c.min[b];
+			if(c.max[b] > c.total_max) c.total_max = c.max[b];
+		}
+		c.valid = true;
+	}
+
+	/** Reduction operations for reduceAxis, combining values into an accumulator of type acc_type */
+	struct SumOp {
+		typedef accum_type acc_type;
+		template <class V> static void apply(acc_type &a, const V b) { a += b; }
+	};
+	struct MinOp {
+		typedef T acc_type;
+		static void apply(T &a, const T b) { a = (b < a) ? b : a; }
+	};
+	struct MaxOp {
+		typedef T acc_type;
+		static void apply(T &a, const T b) { a = (b > a) ? b : a; }
+	};
+
+	/** Sum of all elements in the accumulator type */
+	accum_type total() const {
+		if(this->cache != NULL) {
+			this->refresh();
+			return this->cache->total_sum;
+		}
+		accum_type ret(0);
+		for(size_t i=0;i<this->n;i++)
+			ret += this->val[i];
+		return ret;
+	}
+
+	/**
+	 * Reduce the data, seen as (inner x len x outer) array, along the middle axis into dst of
+	 * size (inner x outer). Lines along the reduced axis are never walked with a stride:
+	 * For inner > 1 whole contiguous rows are combined elementwise, otherwise each contiguous
+	 * line is reduced with independent accumulators. Both loops vectorize, threads split the
+	 * outer dimension and chunks of the rows.
+	 */
+	template <class Op>
+	static void reduceAxis(const T* src, T* dst, const size_t inner, const size_t len, const size_t outer) {
+		typedef typename Op::acc_type A;
+		if(len == 0) return;
+		if(inner == 1) {
+			#pragma omp parallel for schedule(static) if(outer*len > 32768)
+			for(long o=0;o<(long)outer;o++) {
+				const T* line = src + o*len;
+				A acc[8];
+				size_t l;
+				if(len >= 8) {
+					for(int j=0;j<8;j++) acc[j] = line[j];
+					for(l=8;l+8<=len;l+=8)
+						for(int j=0;j<8;j++) Op::apply(acc[j], line[l+j]);
+					for(int j=1;j<8;j++) Op::apply(acc[0], acc[j]);
+				} else {
+					acc[0] = line[0];
+					l = 1;
+				}
+				for(;l<len;l++) Op::apply(acc[0], line[l]);
+				dst[o] = T(acc[0]);
+			}
+		} else {
+			const size_t chunk = 1024;
+			const size_t chunks = (inner + chunk - 1) / chunk;
+			#pragma omp parallel for schedule(static) if(outer*len*inner > 32768)
+			for(long t=0;t<(long)(outer*chunks);t++) {
+				const size_t o = t / chunks;
+				const size_t i0 = (t % chunks) * chunk;
+				const size_t i1 = (i0 + chunk < inner) ? i0 + chunk : inner;
+				const T* block = src + o*len*inner;
+				T* d = dst + o*inner;
+				// Accumulate in dst, or in a buffer if the accumulator is wider than T
+				A buf[std::is_same<A,T>::value ? 1 : chunk];
+				A* acc = std::is_same<A,T>::value ? reinterpret_cast<A*>(d + i0) : buf;
+				for(size_t i=i0;i<i1;i++) acc[i-i0] = block[i];
+				for(size_t l=1;l<len;l++) {
+					const T* row = block + l*inner;
+					for(size_t i=i0;i<i1;i++) Op::apply(acc[i-i0], row[i]);
+				}
+				if(!std::is_same<A,T>::value)
+					for(size_t i=i0;i<i1;i++) d[i] = T(acc[i-i0]);
+			}
+		}
+	}
+
+	/** Reduce the dims of a N-dimensional container along axis into dst, which holds the remaining cells */
+	template <class Op>
+	void reduceAxis(const size_t* dims, const size_t N, const size_t axis, T* dst) const {
+		if(axis >= N) throw "Invalid axis";
+		size_t inner = 1, outer = 1;
+		for(size_t i=0;i<axis;i++) inner *= dims[i];
+		for(size_t i=axis+1;i<N;i++) outer *= dims[i];
+		reduceAxis<Op>(this->val, dst, inner, dims[axis], outer);
+	}
+
+	/** Allocate uninitialized storage for n elements, aligned to Array::alignment */
+	static T* allocate(const size_t n) {
+		void* ptr = NULL;
+		if(posix_memalign(&ptr, alignment, (n > 0 ? n : 1)*sizeof(T)) != 0)
+			throw "Memory error";
+		return (T*)ptr;
+	}
 	
 public:
-	Array() : val(NULL),n(0) {}
+	/** Alignment of the storage in bytes, sufficient for aligned AVX-512 loads */
+	static const size_t alignment = 64;
+
+	typedef T value_type;
+	/** Arrays are stored contiguously, so plain pointers are used as iterators */
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	Array() : val(NULL),n(0),cache(NULL) {}
 	Array(const size_t n) : Array() {
 		resize(n);
 	}
-	Array(const Array &src) {
+	/** Copy the array. The reduction cache is not copied */
+	Array(const Array &src) : cache(NULL) {
 		this->n = src.n;
-		this->val = (T*)malloc(n*sizeof(T));
+		this->val = allocate(n);
 		memcpy(this->val, src.val, n*sizeof(T));
 	}
 	Array(Array &&src) {
 		this->n = src.n;
 		this->val = src.val;
+		this->cache = src.cache;
 		src.n = 0;
 		src.val = NULL;
+		src.cache = NULL;
+	}
+	virtual ~Array() {
+		if(this->val != NULL) free(val);
+		if(this->cache != NULL) delete this->cache;
 	}
-	virtual ~Array() { if(this->val != NULL) free(val); }
 
 	size_t size() const { return this->n; }
 
-	/** Resize the given array, conserving it's internal data */
+	/**
+	 * @return pointer to the contiguous storage of the array.
+	 * Non-const access to the storage or via iterators invalidates the whole reduction cache.
+	 * This happens when the pointer or iterator is handed out: Writes through a pointer or
+	 * iterator that is kept across a cached reduction are not seen by the cache. Call
+	 * invalidateReductions() after such writes, or obtain the pointer again
+	 */
+	T* data() { this->touch(); return this->val; }
+	const T* data() const { return this->val; }
+	iterator begin() { this->touch(); return this->val; }
+	iterator end() { this->touch(); return this->val+this->n; }
+	const_iterator begin() const { return this->val; }
+	const_iterator end() const { return this->val+this->n; }
+	const_iterator cbegin() const { return this->val; }
+	const_iterator cend() const { return this->val+this->n; }
+
+	/** Resize the given array, conserving it's internal data. New elements are zero */
 	void resize(const size_t n) {
 		if(val == NULL) {
-			val = (T*)calloc(n,sizeof(T));
+			val = allocate(n);
+			bzero(val, n*sizeof(T));
 			this->n = n;
 		} else if(this->n == n)  {
 			return;
 		} else {
-			T* val = (T*)realloc(this->val, n*sizeof(T));
-			if(val == NULL) 
-				throw "Memory error";		// XXX This handling is bad but will probably never occur
-			this->val = val;
-
+			// No realloc, since it does not preserve the alignment
+			T* val = allocate(n);
+			memcpy(val, this->val, sizeof(T)*(n < this->n ? n : this->n));
 			if(n > this->n)
-				bzero(this->val+this->n, sizeof(T)*(n-this->n));
+				bzero(val+this->n, sizeof(T)*(n-this->n));
+			free(this->val);
+			this->val = val;
 			this->n = n;
 		}
+		this->touch();
 	}
 	/** Erase the array contents, i.e. set everything to zero */
 	void clear() {
 		bzero(this->val, sizeof(T)*this->n);
+		this->touch();
+	}
+
+	/**
+	 * Enable caching of sum(), avg(), min() and max().
+	 * Results are kept per block of blockSize elements (rounded up to a power of two)
+	 * and every mutating access marks its block as modified, so only modified
+	 * blocks are reduced again. Note that the cached sum adds up per block and
+	 * thus might differ in the last bits from the uncached sum for floating point types.
+	 * Writes through retained pointers or iterators are not tracked, see data()
+	 */
+	void cacheReductions(const size_t blockSize = 4096) {
+		unsigned shift = 0;
+		while((size_t(1) << shift) < blockSize) shift++;
+		if(this->cache != NULL) delete this->cache;
+		this->cache = new ReductionCache(shift);
+		this->cache->resize(this->n);
+	}
+	/** Disable the reduction cache */
+	void uncacheReductions() {
+		if(this->cache != NULL) delete this->cache;
+		this->cache = NULL;
 	}
+	/** @return true if reductions are cached */
+	bool cachesReductions() const { return this->cache != NULL; }
+	/** Mark all elements as modified, e.g. after writes through a retained data() pointer */
+	void invalidateReductions() { this->touch(); }
 
 	const T operator[](const size_t i) const { return this->val[i]; }
-	T& operator[](const size_t i) { return this->val[i]; }
+	T& operator[](const size_t i) { this->touch(i); return this->val[i]; }
 	/** Assign contents from another array to this one */
 	Array<T>& operator=(const Array &src) {
 		this->resize(src.n);	// Also assigns n
 		memcpy(this->val, src.val, n*sizeof(T));
+		this->touch();
 		return *this;
 	}
 	/** Assign a constant value to the array */
 	Array<T>& operator=(const T &t) {
 		for(size_t i=0;i< this->n; i++)
 			this->val[i] = t;
+		this->touch();
 		return *this;
 	}
 
+	/** Sum of all elements, accumulated in accum_type */
 	T sum() const {
 		if(this->n == 0 || this->val == NULL) return 0;
-		T ret(0);
-		for(size_t i=0;i<this->n;i++)
-			ret += this->val[i];
-		return ret;
+		return T(this->total());
 	}
+	/** Average of all elements, accumulated in accum_type */
 	T avg() const {
 		if(this->n == 0 || this->val == NULL) return 0;
-		return this->sum() / this->n;
+		return T(this->total() / this->n);
 	}
 	T min() const {
 		if(this->n == 0 || this->val == NULL) return 0;
+		if(this->cache != NULL) {
+			this->refresh();
+			return this->cache->total_min;
+		}
 		T ret = this->val[0];
 		for(size_t i=1;i<this->n;i++)
 			if(this->val[i] < ret) ret = this->val[i];
@@ -99,6 +397,10 @@ public:
 	}
 	T max() const {
 		if(this->n == 0 || this->val == NULL) return 0;
+		if(this->cache != NULL) {
+			this->refresh();
+			return this->cache->total_max;
+		}
 		T ret = this->val[0];
 		for(size_t i=1;i<this->n;i++)
 			if(this->val[i] > ret) ret = this->val[i];
@@ -111,6 +413,14 @@ class Matrix : public Array<T> {
 protected :
 	size_t dims[2];
 	size_t index(const size_t x, const size_t y) const { return dims[0]*y+x; }
+
+	template <class Op>
+	Array<T> reduce(const size_t axis) const {
+		if(axis >= 2) throw "Invalid axis";
+		Array<T> ret(dims[1-axis]);
+		this->template reduceAxis<Op>(this->dims, 2, axis, ret.data());
+		return ret;
+	}
 public:
 	/** Initialize a new empty matrix */
 	Matrix() : Array<T>(0) {
@@ -122,20 +432,22 @@ public:
 		dims[0] = m;
 		dims[1] = n;
 	}
-	Matrix(const Matrix &src) {
+	Matrix(const Matrix &src) : Array<T>() {
 		this->n = src.n;
-		this->val = (T*)malloc(src.n*sizeof(T));
+		this->val = Array<T>::allocate(src.n);
 		memcpy(this->val, src.val, src.n*sizeof(T));
 		this->dims[0] = src.dims[0];
 		this->dims[1] = src.dims[1];
 	}
-	Matrix(Matrix &&src) {
+	Matrix(Matrix &&src) : Array<T>() {
 		this->n = src.n;
 		this->val = src.val;
 		this->dims[0] = src.dims[0];
 		this->dims[1] = src.dims[1];
+		this->cache = src.cache;
 		src.n = 0;
 		src.val = NULL;
+		src.cache = NULL;
 		src.dims[0] = 0;
 		src.dims[1] = 0;
 	}
@@ -144,6 +456,15 @@ public:
 	size_t size() const { return Array<T>::size(); }
 	
 	
+	typedef IndexIterator<T,2> index_iterator;
+	typedef IndexIterator<const T,2> const_index_iterator;
+
+	/** Iterator over all cells, keeping track of the cell index */
+	index_iterator ibegin() { this->touch(); return index_iterator(this->val, this->dims); }
+	index_iterator iend() { return index_iterator(this->val+this->n, this->dims); }
+	const_index_iterator ibegin() const { return const_index_iterator(this->val, this->dims); }
+	const_index_iterator iend() const { return const_index_iterator(this->val+this->n, this->dims); }
+
 	/** Resize the matrix and clear it's contents */
 	void resize(const size_t m, const size_t n) {
 		Array<T>::resize(m*n);
@@ -153,12 +474,28 @@ public:
 	}
 	
 	const T operator()(const size_t i, const size_t j) const { return this->val[index(i,j)]; }
-	T& operator()(const size_t i, const size_t j) { return this->val[index(i,j)]; }
+	T& operator()(const size_t i, const size_t j) { this->touch(index(i,j)); return this->val[index(i,j)]; }
+
+	using Array<T>::sum;
+	using Array<T>::avg;
+	using Array<T>::min;
+	using Array<T>::max;
+	/** Sum along the given axis (0 = x, 1 = y) */
+	Array<T> sum(const size_t axis) const { return reduce<typename Array<T>::SumOp>(axis); }
+	/** Minimum along the given axis */
+	Array<T> min(const size_t axis) const { return reduce<typename Array<T>::MinOp>(axis); }
+	/** Maximum along the given axis */
+	Array<T> max(const size_t axis) const { return reduce<typename Array<T>::MaxOp>(axis); }
+	/** Average along the given axis */
+	Array<T> avg(const size_t axis) const {
+		Array<T> ret = sum(axis);
+		for(size_t i=0;i<ret.size();i++) ret[i] /= (dims[axis] > 0 ? dims[axis] : 1);
+		return ret;
+	}
 
 	/** Assign contents from another matrix to this one */
 	Matrix<T>& operator=(const Matrix &src) {
-		this->resize(src.n);	// Also assigns n
-		memcpy(this->val, src.val, src.n*sizeof(T));
+		Array<T>::operator=(src);
 		this->dims[0] = src.dims[0];
 		this->dims[1] = src.dims[1];
 		return *this;
@@ -172,6 +509,17 @@ class Cube : public Array<T> {
 protected :
 	size_t dims[3];
 	size_t index(const size_t x, const size_t y, const size_t z) const { return dims[0]*dims[1]*z+y*dims[0]+x; }
+
+	template <class Op>
+	Matrix<T> reduce(const size_t axis) const {
+		if(axis >= 3) throw "Invalid axis";
+		size_t rdims[2];
+		for(size_t i=0,j=0;i<3;i++)
+			if(i != axis) rdims[j++] = dims[i];
+		Matrix<T> ret(rdims[0], rdims[1]);
+		this->template reduceAxis<Op>(this->dims, 3, axis, ret.data());
+		return ret;
+	}
 public:
 	/** Initialize a new empty matrix */
 	Cube() : Array<T>(0) {
@@ -185,22 +533,24 @@ public:
 		dims[1] = n;
 		dims[2] = o;
 	}
-	Cube(const Cube &src) {
+	Cube(const Cube &src) : Array<T>() {
 		this->n = src.n;
-		this->val = (T*)malloc(src.n*sizeof(T));
+		this->val = Array<T>::allocate(src.n);
 		memcpy(this->val, src.val, src.n*sizeof(T));
 		this->dims[0] = src.dims[0];
 		this->dims[1] = src.dims[1];
 		this->dims[2] = src.dims[2];
 	}
-	Cube(Cube &&src) {
+	Cube(Cube &&src) : Array<T>() {
 		this->n = src.n;
 		this->val = src.val;
 		this->dims[0] = src.dims[0];
 		this->dims[1] = src.dims[1];
 		this->dims[2] = src.dims[2];
+		this->cache = src.cache;
 		src.n = 0;
 		src.val = NULL;
+		src.cache = NULL;
 		src.dims[0] = 0;
 		src.dims[1] = 0;
 		src.dims[2] = 0;
@@ -209,6 +559,15 @@ public:
 	size_t size(const size_t i) const { return this->dims[i]; }
 	size_t size() const { return Array<T>::size(); }
 
+	typedef IndexIterator<T,3> index_iterator;
+	typedef IndexIterator<const T,3> const_index_iterator;
+
+	/** Iterator over all cells, keeping track of the cell index */
+	index_iterator ibegin() { this->touch(); return index_iterator(this->val, this->dims); }
+	index_iterator iend() { return index_iterator(this->val+this->n, this->dims); }
+	const_index_iterator ibegin() const { return const_index_iterator(this->val, this->dims); }
+	const_index_iterator iend() const { return const_index_iterator(this->val+this->n, this->dims); }
+
 	/** Resize the cube and clear it's contents */
 	void resize(const size_t n1, const size_t n2, const size_t n3) {
 		Array<T>::resize(n1*n2*n3);
@@ -219,12 +578,28 @@ public:
 	}
 	
 	const T operator()(const size_t i, const size_t j, const size_t k) const { return this->val[index(i,j,k)]; }
-	T& operator()(const size_t i, const size_t j, const size_t k) { return this->val[index(i,j,k)]; }
+	T& operator()(const size_t i, const size_t j, const size_t k) { this->touch(index(i,j,k)); return this->val[index(i,j,k)]; }
+
+	using Array<T>::sum;
+	using Array<T>::avg;
+	using Array<T>::min;
+	using Array<T>::max;
+	/** Sum along the given axis, e.g. column density along z for axis 2 */
+	Matrix<T> sum(const size_t axis) const { return reduce<typename Array<T>::SumOp>(axis); }
+	/** Minimum along the given axis */
+	Matrix<T> min(const size_t axis) const { return reduce<typename Array<T>::MinOp>(axis); }
+	/** Maximum along the given axis */
+	Matrix<T> max(const size_t axis) const { return reduce<typename Array<T>::MaxOp>(axis); }
+	/** Average along the given axis */
+	Matrix<T> avg(const size_t axis) const {
+		Matrix<T> ret = sum(axis);
+		for(size_t i=0;i<ret.size();i++) ret[i] /= (dims[axis] > 0 ? dims[axis] : 1);
+		return ret;
+	}
 
 	/** Assign contents from another matrix to this one */
 	Cube<T>& operator=(const Cube<T> &src) {
-		this->resize(src.n);	// Also assigns n
-		memcpy(this->val, src.val, src.n*sizeof(T));
+		Array<T>::operator=(src);
 		this->dims[0] = src.dims[0];
 		this->dims[1] = src.dims[1];
 		this->dims[2] = src.dims[2];
@@ -241,6 +616,17 @@ protected :
 	size_t index(const size_t x1, const size_t x2, const size_t x3, const size_t x4) const {
 		return x1+x2*dims[0]+x3*dims[0]*dims[1]+x4*dims[0]*dims[1]*dims[2];
 	}
+
+	template <class Op>
+	Cube<T> reduce(const size_t axis) const {
+		if(axis >= 4) throw "Invalid axis";
+		size_t rdims[3];
+		for(size_t i=0,j=0;i<4;i++)
+			if(i != axis) rdims[j++] = dims[i];
+		Cube<T> ret(rdims[0], rdims[1], rdims[2]);
+		this->template reduceAxis<Op>(this->dims, 4, axis, ret.data());
+		return ret;
+	}
 public:
 	/** Initialize a new empty matrix */
 	Tesseract() : Array<T>(0) {
@@ -254,27 +640,38 @@ public:
 		dims[2] = n3;
 		dims[3] = n4;
 	}
-	Tesseract(const Tesseract &src) {
+	Tesseract(const Tesseract &src) : Array<T>() {
 		this->n = src.n;
-		this->val = (T*)malloc(src.n*sizeof(T));
+		this->val = Array<T>::allocate(src.n);
 		memcpy(this->val, src.val, src.n*sizeof(T));
 		for(int i=0;i<4;i++)
 			this->dims[i] = src.dims[i];
 	}
-	Tesseract(Tesseract &&src) {
+	Tesseract(Tesseract &&src) : Array<T>() {
 		this->n = src.n;
 		this->val = src.val;
 		for(int i=0;i<4;i++) {
 			this->dims[i] = src.dims[i];
 			src.dims[i] = 0;
 		}
+		this->cache = src.cache;
 		src.n = 0;
 		src.val = NULL;
+		src.cache = NULL;
 	}
 
 	size_t size(const size_t i) const { return this->dims[i]; }
 	size_t size() const { return Array<T>::size(); }
 
+	typedef IndexIterator<T,4> index_iterator;
+	typedef IndexIterator<const T,4> const_index_iterator;
+
+	/** Iterator over all cells, keeping track of the cell index */
+	index_iterator ibegin() { this->touch(); return index_iterator(this->val, this->dims); }
+	index_iterator iend() { return index_iterator(this->val+this->n, this->dims); }
+	const_index_iterator ibegin() const { return const_index_iterator(this->val, this->dims); }
+	const_index_iterator iend() const { return const_index_iterator(this->val+this->n, this->dims); }
+
 	/** Resize the tesseract and clear it's contents */
 	void resize(const size_t n1, const size_t n2, const size_t n3, const size_t n4) {
 		Array<T>::resize(n1*n2*n3*n4);
@@ -286,12 +683,28 @@ public:
 	}
 	
 	const T operator()(const size_t x1, const size_t x2, const size_t x3, const size_t x4) const { return this->val[index(x1,x2,x3,x4)]; }
-	T& operator()(const size_t x1, const size_t x2, const size_t x3, const size_t x4) { return this->val[index(x1,x2,x3,x4)]; }
+	T& operator()(const size_t x1, const size_t x2, const size_t x3, const size_t x4) { this->touch(index(x1,x2,x3,x4)); return this->val[index(x1,x2,x3,x4)]; }
+
+	using Array<T>::sum;
+	using Array<T>::avg;
+	using Array<T>::min;
+	using Array<T>::max;
+	/** Sum along the given axis */
+	Cube<T> sum(const size_t axis) const { return reduce<typename Array<T>::SumOp>(axis); }
+	/** Minimum along the given axis */
+	Cube<T> min(const size_t axis) const { return reduce<typename Array<T>::MinOp>(axis); }
+	/** Maximum along the given axis */
+	Cube<T> max(const size_t axis) const { return reduce<typename Array<T>::MaxOp>(axis); }
+	/** Average along the given axis */
+	Cube<T> avg(const size_t axis) const {
+		Cube<T> ret = sum(axis);
+		for(size_t i=0;i<ret.size();i++) ret[i] /= (dims[axis] > 0 ? dims[axis] : 1);
+		return ret;
+	}
 
 	/** Assign contents from another matrix to this one */
 	Tesseract<T>& operator=(const Tesseract<T> &src) {
-		this->resize(src.n);	// Also assigns n
-		memcpy(this->val, src.val, src.n*sizeof(T));
+		Array<T>::operator=(src);
 		for(int i=0;i<4;i++)
 			this->dims[i] = src.dims[i];
 		return *this;
@@ -0,0 +1,749 @@
+/* =============================================================================
+ *
+ * Title:       Particle-mesh operations
+ * Author:      Felix Niederwanger
+ * License:     MIT (http://opensource.org/licenses/MIT)
+ * Description: Particle containers, particle pushers and interpolation between
+ *              particles and Cube fields for particle in cell codes. Particle
+ *              positions are given in cell units, i.e. the value of cell
+ *              (i,j,k) sits at the position (i,j,k). The grid is periodic in
+ *              all directions.
+ *              Standalone header file
+ * =============================================================================
+ */
+
+#ifndef _NUMERIC_PARTICLES_HPP_
+#define _NUMERIC_PARTICLES_HPP_
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "numeric.hpp"
+
+namespace numeric {
+
+/**
+ * Structure of arrays particle container. Every particle component (e.g. x, y, z,
+ * ux, ...) is stored in its own named column, backed by an aligned Array, so SIMD
+ * kernels stream over single components and columns can be written to datasets
+ * directly. Columns hold capacity() elements, of which the first size() are valid.
+ */
+template <class T>
+class ParticleArray {
+protected:
+	std::vector<std::string> names;
+	std::vector< Array<T> > columns;
+	/** Number of particles */
+	size_t n;
+	/** Allocated particles per column */
+	size_t cap;
+
+public:
+	/**
+	 * Create a new empty particle array
+	 * @param names Names of the particle components
+	 * @param capacity Initial capacity
+	 */
+	ParticleArray(const std::vector<std::string> &names, const size_t capacity = 0) : names(names), n(0), cap(0) {
+		this->columns.resize(names.size());
+		this->reserve(capacity);
+	}
+	virtual ~ParticleArray() {}
+
+	/** Number of particles */
+	size_t size() const { return this->n; }
+	/** Number of particles that fit without reallocation */
+	size_t capacity() const { return this->cap; }
+	/** Number of components per particle */
+	size_t components() const { return this->names.size(); }
+	/** Name of component c */
+	const std::string& name(const size_t c) const { return this->names[c]; }
+
+	/** @return index of the component with the given name, throws if there is no such component */
+	size_t component(const std::string &name) const {
+		for(size_t c=0;c<this->names.size();c++)
+			if(this->names[c] == name) return c;
+		throw "Unknown particle component";
+	}
+
+	/** Column of component c, holding size() valid particles */
+	T* data(const size_t c) { return this->columns[c].data(); }
+	const T* data(const size_t c) const { return this->columns[c].data(); }
+	T* data(const std::string &name) { return this->data(this->component(name)); }
+	const T* data(const std::string &name) const { return this->data(this->component(name)); }
+	T* operator[](const std::string &name) { return this->data(name); }
+	const T* operator[](const std::string &name) const { return this->data(name); }
+
+	/** Make sure that capacity particles fit without reallocation */
+	void reserve(const size_t capacity) {
+		if(capacity <= this->cap) return;
+		for(size_t c=0;c<this->columns.size();c++)
+			this->columns[c].resize(capacity);
+		this->cap = capacity;
+	}
+	/** Release unused capacity */
+	void shrink() {
+		for(size_t c=0;c<this->columns.size();c++)
+			this->columns[c].resize(this->n);
+		this->cap = this->n;
+	}
+	/** Remove all particles, keeping the capacity */
+	void clear() { this->n = 0; }
+
+	/**
+	 * Append count zero-initialized particles. Capacity grows geometrically
+	 * @return index of the first new particle
+	 */
+	size_t append(const size_t count) {
+		const size_t first = this->n;
+		if(first + count > this->cap) {
+			size_t capacity = (this->cap > 0) ? this->cap : 64;
+			while(capacity < first + count) capacity *= 2;
+			this->reserve(capacity);
+		}
+		for(size_t c=0;c<this->columns.size();c++)
+			bzero(this->columns[c].data()+first, count*sizeof(T));
+		this->n += count;
+		return first;
+	}
+
+	/**
+	 * Append count particles, given as one source array per component
+	 * @param src components() arrays of count values, in component order
+	 * @return index of the first new particle
+	 */
+	size_t append(const T* const* src, const size_t count) {
+		const size_t first = this->append(count);
+		for(size_t c=0;c<this->columns.size();c++)
+			memcpy(this->columns[c].data()+first, src[c], count*sizeof(T));
+		return first;
+	}
+
+	/**
+	 * Remove all particles with a nonzero entry in the mask and compact the
+	 * remaining particles, preserving their order. Columns are compacted in parallel
+	 * @param mask Mask of size() entries
+	 * @return number of removed particles
+	 */
+	size_t remove(const unsigned char* mask) {
+		// Destination of every particle, computed once for all columns
+		size_t first = 0;
+		while(first < this->n && !mask[first]) first++;
+		if(first == this->n) return 0;
+		std::vector<size_t> keep;
+		keep.reserve(this->n - first);
+		for(size_t p=first;p<this->n;p++)
+			if(!mask[p]) keep.push_back(p);
+
+		const long columns = (long)this->columns.size();
+		#pragma omp parallel for schedule(static)
+		for(long c=0;c<columns;c++) {
+			T* col = this->columns[c].data();
+			for(size_t i=0;i<keep.size();i++)
+				col[first+i] = col[keep[i]];
+		}
+		const size_t removed = this->n - (first + keep.size());
+		this->n = first + keep.size();
+		return removed;
+	}
+};
+
+
+/** Particle shape (assignment) functions. The value is the stencil width in cells */
+enum Shape {
+	/** Nearest grid point */
+	SHAPE_NGP = 1,
+	/** Cloud in cell, i.e. linear (trilinear in 3d) weighting */
+	SHAPE_CIC = 2,
+	/** Triangular shaped cloud, quadratic spline weighting */
+	SHAPE_TSC = 3
+};
+
+/**
+ * 1d weights of the shape function of width W at position x
+ * @param i0 First cell of the stencil, might be outside of the grid
+ * @param w Weights of the cells i0 ... i0+W-1
+ */
+template <int W, class T>
+inline void shapeWeights(const T x, long &i0, T* w) {
+	if(W == 1) {
+		i0 = (long)floor(x + T(0.5));
+		w[0] = T(1);
+	} else if(W == 2) {
+		i0 = (long)floor(x);
+		const T f = x - (T)i0;
+		w[0] = T(1) - f;
+		w[1] = f;
+	} else {
+		const long i = (long)floor(x + T(0.5));
+		const T d = x - (T)i;
+		i0 = i-1;
+		w[0] = T(0.5)*(T(0.5)-d)*(T(0.5)-d);
+		w[1] = T(0.75)-d*d;
+		w[2] = T(0.5)*(T(0.5)+d)*(T(0.5)+d);
+	}
+}
+
+/** Wrap a position into [0,n) */
+template <class T>
+inline T wrapPosition(const T x, const size_t n) {
+	return x - (T)n * floor(x / (T)n);
+}
+
+/** Wrap a stencil index of a wrapped position, which is at most one period off */
+inline size_t wrapIndex(const long i, const long n) {
+	return (size_t)((i < 0) ? i+n : ((i >= n) ? i-n : i));
+}
+
+/** Linear cell index of the nearest grid point of a position */
+template <class T>
+inline size_t cellIndex(const T x, const T y, const T z, const size_t nx, const size_t ny, const size_t nz) {
+	const size_t ix = wrapIndex((long)floor(wrapPosition(x, nx) + T(0.5)), (long)nx);
+	const size_t iy = wrapIndex((long)floor(wrapPosition(y, ny) + T(0.5)), (long)ny);
+	const size_t iz = wrapIndex((long)floor(wrapPosition(z, nz) + T(0.5)), (long)nz);
+	return (iz*ny + iy)*nx + ix;
+}
+
+/**
+ * Order of n particles by their nearest grid cell (counting sort)
+ * @param order output array of n particle indices
+ */
+template <class T>
+void cellOrder(const size_t nx, const size_t ny, const size_t nz, const T* x, const T* y, const T* z, const size_t n, size_t* order) {
+	std::vector<size_t> cell(n);
+	std::vector<size_t> offset(nx*ny*nz+1, 0);
+	for(size_t p=0;p<n;p++) {
+		cell[p] = cellIndex(x[p], y[p], z[p], nx, ny, nz);
+		offset[cell[p]+1]++;
+	}
+	for(size_t c=1;c<offset.size();c++) offset[c] += offset[c-1];
+	for(size_t p=0;p<n;p++) order[offset[cell[p]]++] = p;
+}
+
+/** Gather kernel for shape width W over the particles [begin,end), optionally in the given order */
+template <int W, class T>
+void gatherKernel(const Cube<T> &field, const T* x, const T* y, const T* z, T* out, const size_t begin, const size_t end, const size_t* order) {
+	const size_t nx = field.size(0), ny = field.size(1), nz = field.size(2);
+	const T* val = field.data();
+	#pragma omp simd
+	for(size_t p=begin;p<end;p++) {
+		const size_t q = (order != NULL) ? order[p] : p;
+		long i0, j0, k0;
+		T wx[W], wy[W], wz[W];
+		shapeWeights<W>(wrapPosition(x[q], nx), i0, wx);
+		shapeWeights<W>(wrapPosition(y[q], ny), j0, wy);
+		shapeWeights<W>(wrapPosition(z[q], nz), k0, wz);
+		size_t ix[W];
+		for(int a=0;a<W;a++) ix[a] = wrapIndex(i0+a, (long)nx);
+
+		T acc(0);
+		for(int c=0;c<W;c++) {
+			const size_t plane = wrapIndex(k0+c, (long)nz)*ny;
+			for(int b=0;b<W;b++) {
+				const T* row = val + (plane + wrapIndex(j0+b, (long)ny))*nx;
+				const T wyz = wy[b]*wz[c];
+				for(int a=0;a<W;a++)
+					acc += wyz*wx[a]*row[ix[a]];
+			}
+		}
+		out[q] = acc;
+	}
+}
+
+/**
+ * Interpolate the field at n particle positions (structure of arrays). Particles are
+ * processed in parallel blocks, the inner loop over the particles vectorizes with
+ * gathers of the stencil values.
+ * @param out Interpolated values, in the order of the given positions
+ * @param shape Particle shape function
+ * @param presort If true, particles are first ordered by cell, so that neighbouring
+ *                particles read neighbouring field values. Pays off for unsorted
+ *                particles on large grids
+ */
+template <class T>
+void gather(const Cube<T> &field, const T* x, const T* y, const T* z, T* out, const size_t n, const Shape shape = SHAPE_CIC, const bool presort = false) {
+	std::vector<size_t> order;
+	if(presort) {
+		order.resize(n);
+		cellOrder(field.size(0), field.size(1), field.size(2), x, y, z, n, order.data());
+	}
+	const size_t* ord = presort ? order.data() : NULL;
+	const size_t block = 1024;
+	const long blocks = (long)((n + block - 1) / block);
+	#pragma omp parallel for schedule(static)
+	for(long b=0;b<blocks;b++) {
+		const size_t begin = b*block;
+		const size_t end = (begin + block < n) ? begin + block : n;
+		switch(shape) {
+		case SHAPE_NGP: gatherKernel<1>(field, x, y, z, out, begin, end, ord); break;
+		case SHAPE_CIC: gatherKernel<2>(field, x, y, z, out, begin, end, ord); break;
+		case SHAPE_TSC: gatherKernel<3>(field, x, y, z, out, begin, end, ord); break;
+		}
+	}
+}
+
+/** Deposit kernel for shape width W of the particles idx[begin,end) into val */
+template <int W, class T>
+void depositKernel(T* val, const size_t nx, const size_t ny, const size_t nz, const T* x, const T* y, const T* z, const T* w, const size_t* idx, const size_t begin, const size_t end) {
+	for(size_t p=begin;p<end;p++) {
+		const size_t q = (idx != NULL) ? idx[p] : p;
+		long i0, j0, k0;
+		T wx[W], wy[W], wz[W];
+		shapeWeights<W>(wrapPosition(x[q], nx), i0, wx);
+		shapeWeights<W>(wrapPosition(y[q], ny), j0, wy);
+		shapeWeights<W>(wrapPosition(z[q], nz), k0, wz);
+		const T weight = (w != NULL) ? w[q] : T(1);
+		size_t ix[W];
+		for(int a=0;a<W;a++) ix[a] = wrapIndex(i0+a, (long)nx);
+
+		for(int c=0;c<W;c++) {
+			const size_t plane = wrapIndex(k0+c, (long)nz)*ny;
+			for(int b=0;b<W;b++) {
+				T* row = val + (plane + wrapIndex(j0+b, (long)ny))*nx;
+				const T wyz = weight*wy[b]*wz[c];
+				for(int a=0;a<W;a++)
+					row[ix[a]] += wyz*wx[a];
+			}
+		}
+	}
+}
+
+template <class T>
+inline void depositRange(T* val, const size_t nx, const size_t ny, const size_t nz, const T* x, const T* y, const T* z, const T* w, const size_t* idx, const size_t begin, const size_t end, const Shape shape) {
+	switch(shape) {
+	case SHAPE_NGP: depositKernel<1>(val, nx, ny, nz, x, y, z, w, idx, begin, end); break;
+	case SHAPE_CIC: depositKernel<2>(val, nx, ny, nz, x, y, z, w, idx, begin, end); break;
+	case SHAPE_TSC: depositKernel<3>(val, nx, ny, nz, x, y, z, w, idx, begin, end); break;
+	}
+}
+
+/**
+ * Scatter-add n particle weights onto the target cube (e.g. charge deposition).
+ * The grid is split into z-slabs of at least three cells, and particles are binned by
+ * the slab of their nearest cell. Since a stencil reaches at most one cell into the
+ * neighbouring slabs, all even slabs and then all odd slabs can be deposited in
+ * parallel directly into the target, without atomics or private copies of the grid.
+ * @param w Particle weights or NULL for unit weights
+ */
+template <class T>
+void deposit(Cube<T> &target, const T* x, const T* y, const T* z, const T* w, const size_t n, const Shape shape = SHAPE_CIC) {
+	const size_t nx = target.size(0), ny = target.size(1), nz = target.size(2);
+	T* val = target.data();
+#ifdef _OPENMP
+	const size_t threads = (size_t)omp_get_max_threads();
+#else
+	const size_t threads = 1;
+#endif
+	size_t thickness = nz / (2*threads);
+	if(thickness < 3) thickness = 3;
+	size_t slabs = nz / thickness;
+	if(slabs % 2 != 0) slabs--;
+	if(threads == 1 || slabs < 2) {
+		depositRange(val, nx, ny, nz, x, y, z, w, (const size_t*)NULL, 0, n, shape);
+		return;
+	}
+
+	// Bin particles by slab (counting sort), the last slab takes the remainder
+	std::vector<size_t> slab(n), offset(slabs+1, 0), idx(n);
+	for(size_t p=0;p<n;p++) {
+		const size_t k = wrapIndex((long)floor(wrapPosition(z[p], nz) + T(0.5)), (long)nz);
+		slab[p] = (k / thickness < slabs) ? k / thickness : slabs-1;
+		offset[slab[p]+1]++;
+	}
+	for(size_t s=1;s<=slabs;s++) offset[s] += offset[s-1];
+	std::vector<size_t> fill(offset.begin(), offset.end()-1);
+	for(size_t p=0;p<n;p++) idx[fill[slab[p]]++] = p;
+
+	for(long color=0;color<2;color++) {
+		#pragma omp parallel for schedule(dynamic)
+		for(long s=color;s<(long)slabs;s+=2)
+			depositRange(val, nx, ny, nz, x, y, z, w, idx.data(), offset[s], offset[s+1], shape);
+	}
+}
+
+/** Morton (Z-order) code of a cell, interleaving 21 bits of each index */
+inline uint64_t mortonCode(const size_t i, const size_t j, const size_t k) {
+	uint64_t ret = 0;
+	for(int b=0;b<21;b++) {
+		ret |= (uint64_t)((i >> b) & 1) << (3*b);
+		ret |= (uint64_t)((j >> b) & 1) << (3*b+1);
+		ret |= (uint64_t)((k >> b) & 1) << (3*b+2);
+	}
+	return ret;
+}
+
+/**
+ * Sorts the particles of a ParticleArray by their nearest grid cell, so that gather
+ * and deposition walk the field in order. Cells are ordered either linearly (x fastest)
+ * or along a Morton curve, which keeps neighbours in all three directions close.
+ * After sorting, the particles of a cell are [begin(i,j,k), end(i,j,k)).
+ */
+template <class T>
+class CellSort {
+protected:
+	size_t dims[3];
+	/** Rank of every linear cell index along the Morton curve, empty for linear order */
+	std::vector<size_t> rank;
+	/** Particles of the cell with rank r are [offsets[r], offsets[r+1]) */
+	std::vector<size_t> offsets;
+	/** Cell rank of every particle */
+	std::vector<size_t> keys;
+	std::string names[3];
+
+	size_t cells() const { return dims[0]*dims[1]*dims[2]; }
+
+	/** Compute the cell rank of all particles */
+	void computeKeys(const ParticleArray<T> &particles) {
+		const size_t n = particles.size();
+		const T* x = particles[this->names[0]];
+		const T* y = particles[this->names[1]];
+		const T* z = particles[this->names[2]];
+		this->keys.resize(n);
+		#pragma omp parallel for schedule(static)
+		for(long p=0;p<(long)n;p++) {
+			const size_t cell = cellIndex(x[p], y[p], z[p], dims[0], dims[1], dims[2]);
+			this->keys[p] = this->rank.empty() ? cell : this->rank[cell];
+		}
+	}
+
+	/** Reorder all particle columns and the keys: new particle i is old particle perm[i] */
+	void permute(ParticleArray<T> &particles, const std::vector<size_t> &perm) {
+		const long n = (long)perm.size();
+		std::vector<T> tmp(n);
+		for(size_t c=0;c<particles.components();c++) {
+			T* col = particles.data(c);
+			#pragma omp parallel for schedule(static)
+			for(long i=0;i<n;i++) tmp[i] = col[perm[i]];
+			memcpy(col, tmp.data(), n*sizeof(T));
+		}
+		std::vector<size_t> keys(n);
+		#pragma omp parallel for schedule(static)
+		for(long i=0;i<n;i++) keys[i] = this->keys[perm[i]];
+		this->keys.swap(keys);
+	}
+
+	/** Build the offset table from the sorted keys */
+	void buildOffsets() {
+		this->offsets.assign(this->cells()+1, 0);
+		for(size_t p=0;p<this->keys.size();p++)
+			this->offsets[this->keys[p]+1]++;
+		for(size_t c=1;c<this->offsets.size();c++)
+			this->offsets[c] += this->offsets[c-1];
+	}
+
+	/** Maximum number of coarse buckets of countingSort */
+	static const size_t SORT_BUCKETS = 4096;
+
+	/**
+	 * Parallel, stable counting sort by the current keys in two passes, so that no histogram
+	 * grows with threads*cells:
+	 * 1. Every thread counts a contiguous chunk of particles into its own histogram over at
+	 *    most SORT_BUCKETS coarse buckets of consecutive keys. A scan over (bucket, thread)
+	 *    gives every chunk its destinations, and the chunks are scattered into the buckets.
+	 * 2. The buckets are sorted independently by a counting sort over their keys, which also
+	 *    fills the offset table. Every thread keeps one bucket-sized histogram.
+	 */
+	void countingSort(ParticleArray<T> &particles) {
+		const size_t n = particles.size();
+		const size_t cells = this->cells();
+#ifdef _OPENMP
+		const size_t threads = (n > 65536) ? (size_t)omp_get_max_threads() : 1;
+#else
+		const size_t threads = 1;
+#endif
+		if(cells == 0) return;
+		// Bucket b holds the keys [b << shift, (b+1) << shift)
+		unsigned shift = 0;
+		while(((cells - 1) >> shift) + 1 > SORT_BUCKETS) shift++;
+		const size_t buckets = ((cells - 1) >> shift) + 1;
+		const size_t width = (size_t)1 << shift;
+		const size_t chunk = (n + threads - 1) / threads;
+		std::vector<size_t> hist(threads*buckets, 0);		// hist[thread*buckets + bucket]
+		std::vector<size_t> start(buckets+1);
+		std::vector<size_t> index(n), key(n);
+		std::vector<size_t> perm(n);
+
+		#pragma omp parallel for schedule(static) num_threads(threads)
+		for(long t=0;t<(long)threads;t++) {
+			size_t* h = &hist[t*buckets];
+			const size_t end = (t*chunk + chunk < n) ? t*chunk + chunk : n;
+			for(size_t p=t*chunk;p<end;p++) h[this->keys[p] >> shift]++;
+		}
+		size_t sum = 0;
+		for(size_t b=0;b<buckets;b++) {
+			start[b] = sum;
+			for(size_t t=0;t<threads;t++) {
+				const size_t count = hist[t*buckets + b];
+				hist[t*buckets + b] = sum;
+				sum += count;
+			}
+		}
+		start[buckets] = n;
+		#pragma omp parallel for schedule(static) num_threads(threads)
+		for(long t=0;t<(long)threads;t++) {
+			size_t* h = &hist[t*buckets];
+			const size_t end = (t*chunk + chunk < n) ? t*chunk + chunk : n;
+			for(size_t p=t*chunk;p<end;p++) {
+				const size_t i = h[this->keys[p] >> shift]++;
+				index[i] = p;
+				key[i] = this->keys[p];
+			}
+		}
+
+		this->offsets.resize(cells+1);
+		if(shift == 0) {
+			// Every bucket is a single cell and thus already sorted
+			std::copy(start.begin(), start.end(), this->offsets.begin());
+			this->permute(particles, index);
+			return;
+		}
+		this->offsets[cells] = n;
+		#pragma omp parallel num_threads(threads)
+		{
+			std::vector<size_t> local(width);
+			#pragma omp for schedule(dynamic)
+			for(long b=0;b<(long)buckets;b++) {
+				const size_t first = (size_t)b << shift;
+				const size_t last = (first + width < cells) ? first + width : cells;
+				std::fill(local.begin(), local.begin() + (last - first), 0);
+				for(size_t i=start[b];i<start[b+1];i++) local[key[i] - first]++;
+				size_t pos = start[b];
+				for(size_t c=first;c<last;c++) {
+					const size_t count = local[c - first];
+					local[c - first] = pos;
+					this->offsets[c] = pos;
+					pos += count;
+				}
+				for(size_t i=start[b];i<start[b+1];i++) perm[local[key[i] - first]++] = index[i];
+			}
+		}
+		this->permute(particles, perm);
+	}
+
+public:
+	/**
+	 * @param morton Order cells along a Morton curve instead of linearly
+	 * @param x,y,z Names of the position components
+	 */
+	CellSort(const size_t nx, const size_t ny, const size_t nz, const bool morton = false, const std::string x = "x", const std::string y = "y", const std::string z = "z") {
+		dims[0] = nx;
+		dims[1] = ny;
+		dims[2] = nz;
+		names[0] = x;
+		names[1] = y;
+		names[2] = z;
+		if(morton) {
+			// Rank the cells by their Morton code, which is sparse for non power-of-two grids
+			std::vector< std::pair<uint64_t,size_t> > codes(this->cells());
+			for(size_t k=0,c=0;k<nz;k++)
+				for(size_t j=0;j<ny;j++)
+					for(size_t i=0;i<nx;i++,c++)
+						codes[c] = std::make_pair(mortonCode(i,j,k), c);
+			std::sort(codes.begin(), codes.end());
+			this->rank.resize(codes.size());
+			for(size_t r=0;r<codes.size();r++)
+				this->rank[codes[r].second] = r;
+		}
+		this->offsets.assign(this->cells()+1, 0);
+	}
+
+	/** Sort all particles by cell, see countingSort */
+	void sort(ParticleArray<T> &particles) {
+		this->computeKeys(particles);
+		this->countingSort(particles);
+	}
+
+	/**
+	 * Restore the cell order after the particles moved (or were appended or removed).
+	 * Particles that are still in order stay a sorted sequence; only the out-of-order
+	 * particles are sorted and merged back in. If more than maxFraction of the particles
+	 * are out of order, a full sort is done instead.
+	 * @return number of particles that were out of order
+	 */
+	size_t update(ParticleArray<T> &particles, const double maxFraction = 0.1) {
+		this->computeKeys(particles);
+		const size_t n = particles.size();
+		std::vector<size_t> stay, moved;
+		stay.reserve(n);
+		for(size_t p=0;p<n;p++) {
+			const size_t key = this->keys[p];
+			const bool inOrder = (stay.empty() || key >= this->keys[stay.back()]) && (p+1 == n || key <= this->keys[p+1]);
+			if(inOrder) stay.push_back(p);
+			else moved.push_back(p);
+		}
+		if(moved.empty()) {
+			this->buildOffsets();
+			return 0;
+		}
+		if(moved.size() > maxFraction * n) {
+			// The keys are up to date, only the counting sort is left
+			this->countingSort(particles);
+			return moved.size();
+		}
+
+		struct ByKey {
+			const std::vector<size_t> &keys;
+			ByKey(const std::vector<size_t> &keys) : keys(keys) {}
+			bool operator()(const size_t a, const size_t b) const { return keys[a] < keys[b]; }
+		} byKey(this->keys);
+		std::stable_sort(moved.begin(), moved.end(), byKey);
+		std::vector<size_t> perm(n);
+		std::merge(stay.begin(), stay.end(), moved.begin(), moved.end(), perm.begin(), byKey);
+		this->permute(particles, perm);
+		this->buildOffsets();
+		return moved.size();
+	}
+
+	/** First particle in cell (i,j,k) after sorting */
+	size_t begin(const size_t i, const size_t j, const size_t k) const { return this->offsets[this->key(i,j,k)]; }
+	/** One past the last particle in cell (i,j,k) after sorting */
+	size_t end(const size_t i, const size_t j, const size_t k) const { return this->offsets[this->key(i,j,k)+1]; }
+	/** Position of cell (i,j,k) in the sort order */
+	size_t key(const size_t i, const size_t j, const size_t k) const {
+		const size_t cell = (k*dims[1] + j)*dims[0] + i;
+		return this->rank.empty() ? cell : this->rank[cell];
+	}
+	/** Offset table of size cells+1, indexed by the position of the cell in the sort order */
+	const std::vector<size_t>& table() const { return this->offsets; }
+};
+
+/**
+ * Particle columns and interpolated fields at the particle positions for the pushers.
+ * Momenta are u = gamma*v, all arrays hold n entries
+ */
+template <class T>
+struct PushArrays {
+	T *x, *y, *z;
+	T *ux, *uy, *uz;
+	const T *ex, *ey, *ez;
+	const T *bx, *by, *bz;
+	size_t n;
+
+	PushArrays() : x(NULL), y(NULL), z(NULL), ux(NULL), uy(NULL), uz(NULL),
+		ex(NULL), ey(NULL), ez(NULL), bx(NULL), by(NULL), bz(NULL), n(0) {}
+	/** Use the components x, y, z, ux, uy, uz of the given particles and the given field arrays */
+	PushArrays(ParticleArray<T> &particles, const T* ex, const T* ey, const T* ez, const T* bx, const T* by, const T* bz) :
+		x(particles["x"]), y(particles["y"]), z(particles["z"]), ux(particles["ux"]), uy(particles["uy"]), uz(particles["uz"]),
+		ex(ex), ey(ey), ez(ez), bx(bx), by(by), bz(bz), n(particles.size()) {}
+};
+
+/** Boris push of the particles [begin,end). For REL=false gamma is 1 and c is ignored */
+template <bool REL, class T>
+void borisKernel(const PushArrays<T> &a, const size_t begin, const size_t end, const T qm, const T dt, const T c) {
+	const T h = T(0.5)*qm*dt;
+	const T ic2 = REL ? T(1)/(c*c) : T(0);
+	T* __restrict__ x = a.x; T* __restrict__ y = a.y; T* __restrict__ z = a.z;
+	T* __restrict__ ux = a.ux; T* __restrict__ uy = a.uy; T* __restrict__ uz = a.uz;
+	#pragma omp simd
+	for(size_t p=begin;p<end;p++) {
+		// Half acceleration
+		const T umx = ux[p] + h*a.ex[p], umy = uy[p] + h*a.ey[p], umz = uz[p] + h*a.ez[p];
+		// Rotation
+		const T ig = REL ? T(1)/sqrt(T(1) + (umx*umx + umy*umy + umz*umz)*ic2) : T(1);
+		const T tx = h*ig*a.bx[p], ty = h*ig*a.by[p], tz = h*ig*a.bz[p];
+		const T f = T(2)/(T(1) + tx*tx + ty*ty + tz*tz);
+		const T upx = umx + (umy*tz - umz*ty);
+		const T upy = umy + (umz*tx - umx*tz);
+		const T upz = umz + (umx*ty - umy*tx);
+		const T vx = umx + f*(upy*tz - upz*ty);
+		const T vy = umy + f*(upz*tx - upx*tz);
+		const T vz = umz + f*(upx*ty - upy*tx);
+		// Half acceleration and drift
+		const T nx = vx + h*a.ex[p], ny = vy + h*a.ey[p], nz = vz + h*a.ez[p];
+		const T ign = REL ? T(1)/sqrt(T(1) + (nx*nx + ny*ny + nz*nz)*ic2) : T(1);
+		ux[p] = nx;
+		uy[p] = ny;
+		uz[p] = nz;
+		x[p] += dt*ign*nx;
+		y[p] += dt*ign*ny;
+		z[p] += dt*ign*nz;
+	}
+}
+
+/** Vay push of the particles [begin,end) */
+template <class T>
+void vayKernel(const PushArrays<T> &a, const size_t begin, const size_t end, const T qm, const T dt, const T c) {
+	const T h = T(0.5)*qm*dt;
+	const T ic = T(1)/c;
+	const T ic2 = ic*ic;
+	T* __restrict__ x = a.x; T* __restrict__ y = a.y; T* __restrict__ z = a.z;
+	T* __restrict__ ux = a.ux; T* __restrict__ uy = a.uy; T* __restrict__ uz = a.uz;
+	#pragma omp simd
+	for(size_t p=begin;p<end;p++) {
+		const T tx = h*a.bx[p], ty = h*a.by[p], tz = h*a.bz[p];
+		// u' = u + h*(2E + v x B)
+		const T ig = T(1)/sqrt(T(1) + (ux[p]*ux[p] + uy[p]*uy[p] + uz[p]*uz[p])*ic2);
+		const T vx = ig*ux[p], vy = ig*uy[p], vz = ig*uz[p];
+		const T upx = ux[p] + T(2)*h*a.ex[p] + (vy*tz - vz*ty);
+		const T upy = uy[p] + T(2)*h*a.ey[p] + (vz*tx - vx*tz);
+		const T upz = uz[p] + T(2)*h*a.ez[p] + (vx*ty - vy*tx);
+		// New gamma
+		const T tau2 = tx*tx + ty*ty + tz*tz;
+		const T ustar = (upx*tx + upy*ty + upz*tz)*ic;
+		const T sigma = T(1) + (upx*upx + upy*upy + upz*upz)*ic2 - tau2;
+		const T gn = sqrt(T(0.5)*(sigma + sqrt(sigma*sigma + T(4)*(tau2 + ustar*ustar))));
+		const T ign = T(1)/gn;
+		const T sx = tx*ign, sy = ty*ign, sz = tz*ign;
+		const T s = T(1)/(T(1) + sx*sx + sy*sy + sz*sz);
+		const T us = upx*sx + upy*sy + upz*sz;
+		const T nx = s*(upx + us*sx + (upy*sz - upz*sy));
+		const T ny = s*(upy + us*sy + (upz*sx - upx*sz));
+		const T nz = s*(upz + us*sz + (upx*sy - upy*sx));
+		ux[p] = nx;
+		uy[p] = ny;
+		uz[p] = nz;
+		x[p] += dt*ign*nx;
+		y[p] += dt*ign*ny;
+		z[p] += dt*ign*nz;
+	}
+}
+
+/**
+ * Advance the particles by one time step with the Boris pusher. Positions and
+ * momenta are staggered by half a time step (leapfrog). Particles are split into
+ * parallel blocks, and each block is a SIMD loop over the structure of arrays.
+ * @param qm Charge over mass
+ * @param c Speed of light for the relativistic push, or 0 for the non-relativistic push (u = v)
+ */
+template <class T>
+void borisPush(const PushArrays<T> &a, const T qm, const T dt, const T c = 0) {
+	const size_t block = 4096;
+	const long blocks = (long)((a.n + block - 1) / block);
+	#pragma omp parallel for schedule(static)
+	for(long b=0;b<blocks;b++) {
+		const size_t begin = b*block;
+		const size_t end = (begin + block < a.n) ? begin + block : a.n;
+		if(c > 0) borisKernel<true>(a, begin, end, qm, dt, c);
+		else borisKernel<false>(a, begin, end, qm, dt, c);
+	}
+}
+
+/**
+ * Advance the particles by one time step with the relativistic Vay pusher, which
+ * (unlike Boris) keeps the E x B drift of relativistic particles correct.
+ * @param qm Charge over mass
+ * @param c Speed of light
+ */
+template <class T>
+void vayPush(const PushArrays<T> &a, const T qm, const T dt, const T c) {
+	const size_t block = 4096;
+	const long blocks = (long)((a.n + block - 1) / block);
+	#pragma omp parallel for schedule(static)
+	for(long b=0;b<blocks;b++) {
+		const size_t begin = b*block;
+		const size_t end = (begin + block < a.n) ? begin + block : a.n;
+		vayKernel(a, begin, end, qm, dt, c);
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,174 @@
+/* =============================================================================
+ *
+ * Title:       Multi-resolution pyramids
+ * Author:      Felix Niederwanger
+ * License:     MIT (http://opensource.org/licenses/MIT)
+ * Description: Repeated 2x downsampling of Cube data by averaging or taking the
+ *              maximum or minimum, for visualisation and quick-look output.
+ *              Standalone header file
+ * =============================================================================
+ */
+
+#ifndef _NUMERIC_PYRAMID_HPP_
+#define _NUMERIC_PYRAMID_HPP_
+
+#include <vector>
+#include <type_traits>
+
+#include "numeric.hpp"
+
+namespace numeric {
+
+/** Reduction of the 2x2x2 children of a pyramid cell */
+enum Downsampling {
+	DOWNSAMPLE_AVG = 0,
+	DOWNSAMPLE_MAX = 1,
+	DOWNSAMPLE_MIN = 2
+};
+
+/**
+ * Pyramid of downsampled Cubes. Level i is downsampled by 2^(i+1); each of its cells is
+ * the average, maximum or minimum of the (up to) 2x2x2 cells of the level below. Odd sizes
+ * are rounded up, cells at the upper border then have fewer children.
+ * The first levels are built in a single parallel pass over tiles of the source, so that
+ * every tile is reduced through all these levels while it is in cache
+ */
+template <class T>
+class Pyramid {
+protected:
+	std::vector<Cube<T>> cubes;
+	Downsampling mode;
+
+	/** Number of levels built in one pass over source tiles. Tiles have 2^tileLevels cells per side */
+	static constexpr size_t tileLevels = 4;
+
+	/**
+	 * Type in which the children are added up for averages: at least long for integer types,
+	 * so that the sum of eight children cannot wrap, otherwise the accumulator type of T
+	 */
+	template <class V, bool integral = std::is_integral<V>::value>
+	struct AvgAccum { typedef typename numeric_traits<V>::accum_type type; };
+	template <class V>
+	struct AvgAccum<V, true> { typedef typename std::common_type<V, long>::type type; };
+	typedef typename AvgAccum<T>::type Accum;
+
+	template <int MODE>
+	static inline T combine(const T a, const T b) {
+		if(MODE == DOWNSAMPLE_MAX) return (b > a) ? b : a;
+		return (b < a) ? b : a;
+	}
+
+	/** Average of the cx*cy*cz children starting at p, added up in Accum and divided once */
+	static inline T average(const T* p, const size_t nx, const size_t nxy, const size_t cx, const size_t cy, const size_t cz) {
+		Accum sum(0);
+		for(size_t k=0;k<cz;k++)
+			for(size_t j=0;j<cy;j++)
+				for(size_t i=0;i<cx;i++) sum += p[k*nxy + j*nx + i];
+		return T(sum / Accum(cx*cy*cz));
+	}
+
+	/** Reduce the children of cell (x,y,z) in src */
+	template <int MODE>
+	static T reduce(const Cube<T> &src, const size_t x, const size_t y, const size_t z) {
+		const size_t nx = src.size(0), nxy = src.size(0)*src.size(1);
+		const T* p = src.data() + 2*z*nxy + 2*y*nx + 2*x;
+		const size_t cx = (2*x+2 <= src.size(0)) ? 2 : 1;
+		const size_t cy = (2*y+2 <= src.size(1)) ? 2 : 1;
+		const size_t cz = (2*z+2 <= src.size(2)) ? 2 : 1;
+		if(MODE == DOWNSAMPLE_AVG) {
+			if(cx*cy*cz == 8) return average(p, nx, nxy, 2, 2, 2);
+			return average(p, nx, nxy, cx, cy, cz);
+		}
+		if(cx*cy*cz == 8) {
+			// All eight children exist
+			const T a = combine<MODE>(combine<MODE>(p[0], p[1]), combine<MODE>(p[nx], p[nx+1]));
+			const T b = combine<MODE>(combine<MODE>(p[nxy], p[nxy+1]), combine<MODE>(p[nxy+nx], p[nxy+nx+1]));
+			return combine<MODE>(a, b);
+		}
+		T result = p[0];
+		for(size_t k=0;k<cz;k++)
+			for(size_t j=0;j<cy;j++)
+				for(size_t i=0;i<cx;i++)
+					if(i+j+k > 0) result = combine<MODE>(result, p[k*nxy + j*nx + i]);
+		return result;
+	}
+
+	/** Build levels first..first+count-1 from src in one pass over tiles */
+	template <int MODE>
+	void build(const Cube<T> &src, const size_t first, const size_t count) {
+		const size_t tile = (size_t)1 << count;
+		size_t tiles[3];
+		for(int d=0;d<3;d++) tiles[d] = (src.size(d) + tile - 1) / tile;
+		const size_t total = tiles[0]*tiles[1]*tiles[2];
+		std::vector<T*> data(count);
+		for(size_t l=0;l<count;l++) data[l] = this->cubes[first+l].data();
+
+		#pragma omp parallel for schedule(dynamic)
+		for(long t=0;t<(long)total;t++) {
+			const size_t tile0[3] = {t % tiles[0], (t / tiles[0]) % tiles[1], t / (tiles[0]*tiles[1])};
+			const Cube<T>* below = &src;
+			for(size_t l=0;l<count;l++) {
+				const Cube<T> &dst = this->cubes[first+l];
+				const size_t side = tile >> (l+1);
+				size_t lo[3], hi[3];
+				for(int d=0;d<3;d++) {
+					lo[d] = tile0[d]*side;
+					hi[d] = (lo[d] + side < dst.size(d)) ? lo[d] + side : dst.size(d);
+				}
+				for(size_t z=lo[2];z<hi[2];z++)
+					for(size_t y=lo[1];y<hi[1];y++)
+						for(size_t x=lo[0];x<hi[0];x++)
+							data[l][(z*dst.size(1) + y)*dst.size(0) + x] = reduce<MODE>(*below, x, y, z);
+				below = &dst;
+			}
+		}
+	}
+
+	void build(const Cube<T> &src, const size_t first, const size_t count) {
+		switch(this->mode) {
+			case DOWNSAMPLE_MAX: this->build<DOWNSAMPLE_MAX>(src, first, count); break;
+			case DOWNSAMPLE_MIN: this->build<DOWNSAMPLE_MIN>(src, first, count); break;
+			default: this->build<DOWNSAMPLE_AVG>(src, first, count); break;
+		}
+	}
+
+public:
+	/**
+	 * Build the pyramid of the given Cube
+	 * @param levels Number of levels, 0 to downsample until all dimensions are 1
+	 */
+	Pyramid(const Cube<T> &src, const Downsampling mode = DOWNSAMPLE_AVG, size_t levels = 0) : mode(mode) {
+		size_t dims[3] = {src.size(0), src.size(1), src.size(2)};
+		if(levels == 0) {
+			size_t n = (dims[0] > dims[1]) ? dims[0] : dims[1];
+			if(dims[2] > n) n = dims[2];
+			while(n > 1) {
+				n = (n+1)/2;
+				levels++;
+			}
+		}
+		for(size_t l=0;l<levels;l++) {
+			for(int d=0;d<3;d++) dims[d] = (dims[d]+1)/2;
+			this->cubes.push_back(Cube<T>(dims[0], dims[1], dims[2]));
+		}
+		// Tile passes; each further pass starts from the last level of the previous one
+		for(size_t first=0;first<levels;first+=tileLevels) {
+			const size_t count = (levels - first < tileLevels) ? levels - first : tileLevels;
+			this->build((first == 0) ? src : this->cubes[first-1], first, count);
+		}
+	}
+
+	/** Number of levels */
+	size_t depth() const { return this->cubes.size(); }
+	/** Level i, downsampled by 2^(i+1) */
+	const Cube<T>& level(const size_t i) const { return this->cubes[i]; }
+	const Cube<T>& operator[](const size_t i) const { return this->cubes[i]; }
+	/** All levels, finest first */
+	const std::vector<Cube<T>>& levels() const { return this->cubes; }
+	/** Downsampling factor of level i */
+	static size_t scale(const size_t i) { return (size_t)2 << i; }
+};
+
+}
+
+#endif